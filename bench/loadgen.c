@@ -0,0 +1,431 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "client/api.h"
+#include "common/io.h"
+
+#define NUM_OPS 4
+#define PATH_SIZE 128
+
+// Operations of the mix, in the order of the -m option
+enum BenchOp { OP_CREATE, OP_RESERVE, OP_SHOW, OP_LIST };
+
+static const char* op_names[NUM_OPS] = {"create", "reserve", "show", "list"};
+
+// Parameters of a run
+struct BenchConfig {
+  const char* server_path;       // Server pipe or socket
+  const char* pipe_prefix;       // Prefix of the session pipes
+  unsigned int sessions;         // Concurrent sessions, one process each
+  unsigned int requests;         // Requests sent by each session
+  unsigned int events;           // Events created before the run
+  size_t rows;                   // Rows of every event
+  size_t cols;                   // Columns of every event
+  unsigned int mix[NUM_OPS];     // Relative weight of each operation
+  double zipf_s;                 // Exponent of the event popularity, 0 for uniform
+  uint64_t seed;                 // Seed of the random choices
+};
+
+// Latency of one request, as sent from a session to the parent
+struct Sample {
+  uint32_t op;       // BenchOp of the request
+  uint32_t failed;   // Whether the server rejected the request
+  uint64_t ns;       // Time from the call to its return
+};
+
+// Boundaries of the run of a session
+struct SessionSpan {
+  uint64_t start_ns;  // Instant the first request was sent
+  uint64_t end_ns;    // Instant the last request returned
+  uint64_t count;     // Number of samples that follow
+};
+
+static void print_usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [-n sessions] [-r requests] [-e events] [-g rows x cols] [-m create:reserve:show:list] "
+          "[-z zipf_s] [-S seed] [-p pipe_prefix] <server_path>\n"
+          "  -n  Concurrent sessions (default: 4)\n"
+          "  -r  Requests per session (default: 1000)\n"
+          "  -e  Events created before the run, picked with Zipf popularity (default: 64)\n"
+          "  -g  Size of every event (default: 10x10)\n"
+          "  -m  Weights of the operations (default: 1:60:30:9)\n"
+          "  -z  Zipf exponent of the event popularity, 0 for uniform (default: 0.99)\n"
+          "  -S  Seed of the random choices (default: 1)\n"
+          "  -p  Prefix of the session pipes (default: /tmp/ems_bench)\n"
+          "Results are printed to stdout as one JSON object.\n",
+          program);
+}
+
+/// Gets the current instant.
+/// @return Nanoseconds on CLOCK_MONOTONIC.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/// Draws the next number of a xorshift64* sequence.
+/// @param state State of the sequence, never 0.
+/// @return A uniformly distributed 64-bit number.
+static uint64_t next_random(uint64_t* state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/// Draws a uniformly distributed number in [0, 1).
+static double next_unit(uint64_t* state) { return (double)(next_random(state) >> 11) / 9007199254740992.0; }
+
+/// Builds the cumulative distribution of a Zipf popularity over the events.
+/// @param events Number of events.
+/// @param s Exponent of the distribution; the event of rank k is picked with weight 1 / k^s.
+/// @return Cumulative probabilities, to be freed by the caller. NULL on failure.
+static double* zipf_cdf(unsigned int events, double s) {
+  double* cdf = malloc(events * sizeof(double));
+  if (cdf == NULL) {
+    return NULL;
+  }
+
+  double total = 0;
+  for (unsigned int k = 0; k < events; k++) {
+    total += 1.0 / pow((double)(k + 1), s);
+    cdf[k] = total;
+  }
+  for (unsigned int k = 0; k < events; k++) {
+    cdf[k] /= total;
+  }
+  return cdf;
+}
+
+/// Picks an event according to its popularity.
+/// @param cdf Cumulative distribution of the events.
+/// @param events Number of events.
+/// @param state State of the random sequence.
+/// @return Id of the event, from 1 to events.
+static unsigned int pick_event(const double* cdf, unsigned int events, uint64_t* state) {
+  double u = next_unit(state);
+  unsigned int low = 0, high = events - 1;
+  while (low < high) {
+    unsigned int mid = low + (high - low) / 2;
+    if (cdf[mid] < u) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low + 1;
+}
+
+/// Picks an operation according to the mix.
+/// @param config Parameters of the run.
+/// @param total Sum of the weights of the mix.
+/// @param state State of the random sequence.
+/// @return The BenchOp picked.
+static enum BenchOp pick_op(const struct BenchConfig* config, uint64_t total, uint64_t* state) {
+  uint64_t ticket = next_random(state) % total;
+  for (int op = 0; op < NUM_OPS; op++) {
+    if (ticket < config->mix[op]) {
+      return (enum BenchOp)op;
+    }
+    ticket -= config->mix[op];
+  }
+  return OP_LIST;
+}
+
+/// Opens a session with the server under unique pipe names.
+/// @param config Parameters of the run.
+/// @param index Index of the session.
+/// @return 0 if the session was opened successfully, 1 otherwise.
+static int open_session(const struct BenchConfig* config, unsigned int index) {
+  char req_path[PATH_SIZE], resp_path[PATH_SIZE];
+  snprintf(req_path, sizeof(req_path), "%s_%d_%u_req", config->pipe_prefix, (int)getpid(), index);
+  snprintf(resp_path, sizeof(resp_path), "%s_%d_%u_resp", config->pipe_prefix, (int)getpid(), index);
+  return ems_setup(req_path, resp_path, config->server_path);
+}
+
+/// Runs the requests of one session and sends their latencies to the parent.
+/// @param config Parameters of the run.
+/// @param index Index of the session.
+/// @param start_fd Pipe that is closed by the parent once every session is open.
+/// @param result_fd Pipe to send the SessionSpan and the samples through.
+/// @return Exit status of the session process.
+static int run_session(const struct BenchConfig* config, unsigned int index, int start_fd, int result_fd) {
+  double* cdf = zipf_cdf(config->events, config->zipf_s);
+  struct Sample* samples = malloc(config->requests * sizeof(struct Sample));
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (cdf == NULL || samples == NULL || null_fd == -1) {
+    fprintf(stderr, "Failed to prepare session %u\n", index);
+    return 1;
+  }
+
+  if (open_session(config, index) != 0) {
+    fprintf(stderr, "Failed to open session %u\n", index);
+    return 1;
+  }
+
+  // Wait for every other session to be open, so the run measures them all at once
+  char go;
+  while (read(start_fd, &go, 1) > 0) {
+  }
+  close(start_fd);
+
+  uint64_t state = config->seed * 0x9E3779B97F4A7C15ULL + index + 1;
+  uint64_t total_weight = 0;
+  for (int op = 0; op < NUM_OPS; op++) {
+    total_weight += config->mix[op];
+  }
+
+  // Events created during the run get ids past the preloaded ones, unique per session
+  unsigned int next_created = config->events + 1 + index * config->requests;
+
+  struct SessionSpan span = {.start_ns = now_ns(), .count = config->requests};
+  for (unsigned int i = 0; i < config->requests; i++) {
+    enum BenchOp op = pick_op(config, total_weight, &state);
+    unsigned int event_id = pick_event(cdf, config->events, &state);
+    size_t x = 1 + (size_t)(next_random(&state) % config->rows);
+    size_t y = 1 + (size_t)(next_random(&state) % config->cols);
+
+    uint64_t start = now_ns();
+    int ret = 0;
+    switch (op) {
+      case OP_CREATE:
+        ret = ems_create(next_created++, config->rows, config->cols);
+        break;
+      case OP_RESERVE:
+        ret = ems_reserve(event_id, 1, &x, &y);
+        break;
+      case OP_SHOW:
+        ret = ems_show(null_fd, event_id);
+        break;
+      case OP_LIST:
+        ret = ems_list_events(null_fd);
+        break;
+    }
+    samples[i] = (struct Sample){(uint32_t)op, ret != 0, now_ns() - start};
+  }
+  span.end_ns = now_ns();
+
+  ems_quit();
+
+  if (write_str(result_fd, (char*)&span, sizeof(span)) != 0 ||
+      write_str(result_fd, (char*)samples, config->requests * sizeof(struct Sample)) != 0) {
+    fprintf(stderr, "Failed to report session %u\n", index);
+    return 1;
+  }
+  return 0;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+/// Gets a percentile of sorted latencies.
+/// @param sorted Latencies in ascending order.
+/// @param count Number of latencies.
+/// @param fraction Fraction of the latencies, in millionths.
+/// @return Latency in microseconds.
+static double percentile_us(const uint64_t* sorted, size_t count, uint64_t fraction) {
+  if (count == 0) {
+    return 0;
+  }
+  size_t rank = (size_t)(((uint64_t)count * fraction + 999999) / 1000000);
+  return (double)sorted[rank > 0 ? rank - 1 : 0] / 1e3;
+}
+
+/// Parses a positive number option.
+/// @return 0 if the value is valid, 1 otherwise.
+static int parse_count(const char* arg, unsigned int* value) {
+  char* end;
+  unsigned long parsed = strtoul(arg, &end, 10);
+  if (*end != '\0' || parsed == 0 || parsed > 100000000) {
+    return 1;
+  }
+  *value = (unsigned int)parsed;
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  struct BenchConfig config = {.pipe_prefix = "/tmp/ems_bench", .sessions = 4, .requests = 1000, .events = 64,
+                               .rows = 10, .cols = 10, .mix = {1, 60, 30, 9}, .zipf_s = 0.99, .seed = 1};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:e:g:m:z:S:p:")) != -1) {
+    int invalid = 0;
+    switch (opt) {
+      case 'n':
+        invalid = parse_count(optarg, &config.sessions);
+        break;
+      case 'r':
+        invalid = parse_count(optarg, &config.requests);
+        break;
+      case 'e':
+        invalid = parse_count(optarg, &config.events);
+        break;
+      case 'g':
+        invalid = sscanf(optarg, "%zux%zu", &config.rows, &config.cols) != 2 || config.rows == 0 || config.cols == 0;
+        break;
+      case 'm':
+        invalid = sscanf(optarg, "%u:%u:%u:%u", &config.mix[0], &config.mix[1], &config.mix[2], &config.mix[3]) != 4 ||
+                  config.mix[0] + config.mix[1] + config.mix[2] + config.mix[3] == 0;
+        break;
+      case 'z':
+        config.zipf_s = strtod(optarg, NULL);
+        invalid = config.zipf_s < 0;
+        break;
+      case 'S':
+        config.seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'p':
+        config.pipe_prefix = optarg;
+        break;
+      default:
+        invalid = 1;
+    }
+    if (invalid) {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind != 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  config.server_path = argv[optind];
+
+  // Preload the events through a session of its own
+  if (open_session(&config, config.sessions) != 0) {
+    fprintf(stderr, "Failed to connect to the server\n");
+    return 1;
+  }
+  for (unsigned int id = 1; id <= config.events; id++) {
+    if (ems_create(id, config.rows, config.cols) != 0) {
+      fprintf(stderr, "Failed to create event %u\n", id);
+      ems_quit();
+      return 1;
+    }
+  }
+  ems_quit();
+
+  int start_pipe[2];
+  if (pipe(start_pipe) != 0) {
+    fprintf(stderr, "Failed to create pipe\n");
+    return 1;
+  }
+
+  int* result_fds = malloc(config.sessions * sizeof(int));
+  pid_t* children = malloc(config.sessions * sizeof(pid_t));
+  if (result_fds == NULL || children == NULL) {
+    fprintf(stderr, "Failed to allocate sessions\n");
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < config.sessions; i++) {
+    int result_pipe[2];
+    if (pipe(result_pipe) != 0) {
+      fprintf(stderr, "Failed to create pipe\n");
+      return 1;
+    }
+
+    children[i] = fork();
+    if (children[i] == -1) {
+      fprintf(stderr, "Failed to fork session %u\n", i);
+      return 1;
+    }
+    if (children[i] == 0) {
+      close(start_pipe[1]);
+      close(result_pipe[0]);
+      for (unsigned int j = 0; j < i; j++) {
+        close(result_fds[j]);
+      }
+      exit(run_session(&config, i, start_pipe[0], result_pipe[1]));
+    }
+
+    close(result_pipe[1]);
+    result_fds[i] = result_pipe[0];
+  }
+
+  // Sessions only start once all of them hold their end of the pipe open and this end closes
+  close(start_pipe[0]);
+  close(start_pipe[1]);
+
+  size_t capacity = (size_t)config.sessions * config.requests;
+  uint64_t* latencies[NUM_OPS];
+  size_t counts[NUM_OPS] = {0};
+  size_t failures[NUM_OPS] = {0};
+  for (int op = 0; op < NUM_OPS; op++) {
+    latencies[op] = malloc(capacity * sizeof(uint64_t));
+    if (latencies[op] == NULL) {
+      fprintf(stderr, "Failed to allocate results\n");
+      return 1;
+    }
+  }
+
+  struct Sample* samples = malloc(config.requests * sizeof(struct Sample));
+  uint64_t first_start = UINT64_MAX, last_end = 0;
+  unsigned int completed = 0;
+  for (unsigned int i = 0; i < config.sessions; i++) {
+    struct SessionSpan span;
+    if (samples == NULL || read_str(result_fds[i], (char*)&span, sizeof(span)) != 0 || span.count != config.requests ||
+        read_str(result_fds[i], (char*)samples, config.requests * sizeof(struct Sample)) != 0) {
+      fprintf(stderr, "Session %u did not report\n", i);
+      close(result_fds[i]);
+      continue;
+    }
+    close(result_fds[i]);
+    completed++;
+
+    first_start = span.start_ns < first_start ? span.start_ns : first_start;
+    last_end = span.end_ns > last_end ? span.end_ns : last_end;
+    for (unsigned int j = 0; j < config.requests; j++) {
+      uint32_t op = samples[j].op;
+      latencies[op][counts[op]++] = samples[j].ns;
+      failures[op] += samples[j].failed;
+    }
+  }
+
+  int status = completed == config.sessions ? 0 : 1;
+  for (unsigned int i = 0; i < config.sessions; i++) {
+    int child_status;
+    if (waitpid(children[i], &child_status, 0) == -1 || !WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+      status = 1;
+    }
+  }
+  if (completed == 0) {
+    return 1;
+  }
+
+  double elapsed_s = (double)(last_end - first_start) / 1e9;
+  size_t total = 0;
+  for (int op = 0; op < NUM_OPS; op++) {
+    total += counts[op];
+  }
+
+  printf("{\"sessions\":%u,\"requests\":%zu,\"events\":%u,\"grid\":\"%zux%zu\",\"zipf_s\":%.2f,"
+         "\"elapsed_s\":%.6f,\"throughput_rps\":%.1f,\"ops\":{",
+         completed, total, config.events, config.rows, config.cols, config.zipf_s, elapsed_s,
+         (double)total / elapsed_s);
+  for (int op = 0; op < NUM_OPS; op++) {
+    qsort(latencies[op], counts[op], sizeof(uint64_t), compare_u64);
+    printf("%s\"%s\":{\"count\":%zu,\"failed\":%zu,\"throughput_rps\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,"
+           "\"p999_us\":%.1f,\"max_us\":%.1f}",
+           op > 0 ? "," : "", op_names[op], counts[op], failures[op], (double)counts[op] / elapsed_s,
+           percentile_us(latencies[op], counts[op], 500000), percentile_us(latencies[op], counts[op], 990000),
+           percentile_us(latencies[op], counts[op], 999000), percentile_us(latencies[op], counts[op], 1000000));
+    free(latencies[op]);
+  }
+  printf("}}\n");
+
+  free(samples);
+  free(result_fds);
+  free(children);
+  return status;
+}
@@ -0,0 +1,307 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "server/epoch.h"
+#include "server/eventlist.h"
+#include "server/lockprof.h"
+#include "server/operations.h"
+
+#define MAX_THREADS 64
+
+// Benchmark run by every thread of a measurement
+struct Bench {
+  const char* name;               // Name printed in the results
+  void (*run)(struct Bench*, unsigned int thread, size_t ops);  // Runs ops operations on one thread
+  void (*setup)(struct Bench*);   // Prepares the state before each measurement, may be NULL
+  void (*teardown)(struct Bench*);  // Releases the state after each measurement, may be NULL
+  unsigned int events;            // Events in the state
+  size_t rows;                    // Rows of every event
+  size_t cols;                    // Columns of every event
+  size_t seats;                   // Seats per reservation
+  unsigned int threads;           // Threads of the current measurement
+  struct EventList* list;         // List for the benchmarks that bypass the operations layer
+};
+
+// Thread of a measurement
+struct Worker {
+  struct Bench* bench;         // Benchmark to run
+  unsigned int thread;         // Index of the thread
+  size_t ops;                  // Operations to run
+  pthread_barrier_t* barrier;  // Start line shared by the threads
+  uint64_t elapsed_ns;         // Time the thread took
+};
+
+static size_t ops_per_thread = 200000;
+static unsigned int max_threads = 8;
+
+/// Gets the current instant.
+/// @return Nanoseconds on CLOCK_MONOTONIC.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/// Spreads the bits of a counter, to visit ids in a cache-unfriendly order.
+static uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return x;
+}
+
+/// Creates the events of a benchmark through the operations layer.
+static void setup_events(struct Bench* bench) {
+  if (ems_init(0) != 0) {
+    fprintf(stderr, "Failed to initialize EMS\n");
+    exit(EXIT_FAILURE);
+  }
+  for (unsigned int id = 1; id <= bench->events; id++) {
+    if (ems_create(NULL, id, bench->rows, bench->cols) != 0) {
+      fprintf(stderr, "Failed to create event %u\n", id);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void teardown_events(struct Bench* bench) {
+  (void)bench;
+  ems_terminate();
+}
+
+/// Builds a list of events directly, without the operations layer.
+static void setup_list(struct Bench* bench) {
+  bench->list = create_list();
+  if (bench->list == NULL) {
+    fprintf(stderr, "Failed to create list\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (unsigned int id = 1; id <= bench->events; id++) {
+    struct Event* event = calloc(1, sizeof(struct Event));
+    if (event == NULL || pthread_mutex_init(&event->mutex, NULL) != 0) {
+      fprintf(stderr, "Failed to create event %u\n", id);
+      exit(EXIT_FAILURE);
+    }
+    lock_profile_init(&event->mutex_profile);
+    event->id = id;
+    if (append_to_list(bench->list, event) != 0) {
+      fprintf(stderr, "Failed to append event %u\n", id);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void teardown_list(struct Bench* bench) {
+  free_list(bench->list);
+  bench->list = NULL;
+}
+
+/// Looks up existing events by id, straight through the index.
+static void run_get_event(struct Bench* bench, unsigned int thread, size_t ops) {
+  uint64_t found = 0;
+  for (size_t i = 0; i < ops; i++) {
+    unsigned int id = (unsigned int)(mix(i * MAX_THREADS + thread) % bench->events) + 1;
+    epoch_enter();
+    found += get_event(bench->list, id) != NULL;
+    epoch_exit();
+  }
+  if (found != ops) {
+    fprintf(stderr, "Lookups missed %zu events\n", ops - (size_t)found);
+  }
+}
+
+/// Creates fresh events, each thread in its own range of ids.
+static void run_create(struct Bench* bench, unsigned int thread, size_t ops) {
+  struct EventCache cache;
+  event_cache_init(&cache);
+  unsigned int first = bench->events + 1 + thread * (unsigned int)ops;
+  for (size_t i = 0; i < ops; i++) {
+    ems_create(&cache, first + (unsigned int)i, bench->rows, bench->cols);
+  }
+}
+
+/// Reserves seats that no other reservation asked for: the threads interleave
+/// over the seats of every event, moving to the next event when one fills up.
+static void run_reserve(struct Bench* bench, unsigned int thread, size_t ops) {
+  struct EventCache cache;
+  event_cache_init(&cache);
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+
+  size_t per_event = bench->rows * bench->cols / bench->seats;
+  for (size_t i = 0; i < ops; i++) {
+    size_t slot = i * bench->threads + thread;
+    unsigned int id = (unsigned int)(slot / per_event) + 1;
+    size_t first = (slot % per_event) * bench->seats;
+    for (size_t s = 0; s < bench->seats; s++) {
+      xs[s] = (first + s) / bench->cols + 1;
+      ys[s] = (first + s) % bench->cols + 1;
+    }
+    ems_reserve(&cache, id, bench->seats, xs, ys);
+  }
+}
+
+/// Copies events, each thread spread over all of them.
+static void run_show(struct Bench* bench, unsigned int thread, size_t ops) {
+  struct EventCache cache;
+  event_cache_init(&cache);
+  for (size_t i = 0; i < ops; i++) {
+    size_t rows, cols;
+    unsigned int* seats;
+    unsigned int id = (unsigned int)((i * bench->threads + thread) % bench->events) + 1;
+    if (ems_show(&cache, id, &rows, &cols, &seats) == 0) {
+      free(seats);
+    }
+  }
+}
+
+static void* run_worker(void* arg) {
+  struct Worker* worker = arg;
+  pthread_barrier_wait(worker->barrier);
+  uint64_t start = now_ns();
+  worker->bench->run(worker->bench, worker->thread, worker->ops);
+  worker->elapsed_ns = now_ns() - start;
+  return NULL;
+}
+
+/// Runs a benchmark on the given number of threads.
+/// @param bench Benchmark to run.
+/// @param threads Number of threads.
+/// @param ops Operations per thread.
+/// @return Wall time of the slowest thread, in nanoseconds.
+static uint64_t measure(struct Bench* bench, unsigned int threads, size_t ops) {
+  bench->threads = threads;
+  if (bench->setup != NULL) {
+    bench->setup(bench);
+  }
+
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, NULL, threads);
+  struct Worker workers[MAX_THREADS];
+  pthread_t ids[MAX_THREADS];
+  for (unsigned int t = 0; t < threads; t++) {
+    workers[t] = (struct Worker){bench, t, ops, &barrier, 0};
+    if (pthread_create(&ids[t], NULL, run_worker, &workers[t]) != 0) {
+      fprintf(stderr, "Failed to create thread\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  uint64_t slowest = 0;
+  for (unsigned int t = 0; t < threads; t++) {
+    pthread_join(ids[t], NULL);
+    slowest = workers[t].elapsed_ns > slowest ? workers[t].elapsed_ns : slowest;
+  }
+  pthread_barrier_destroy(&barrier);
+
+  if (bench->teardown != NULL) {
+    bench->teardown(bench);
+  }
+  return slowest;
+}
+
+/// Measures a benchmark at 1, 2, 4... threads and prints a CSV row for each.
+/// @param bench Benchmark to run.
+/// @param ops Operations per thread, lowered by benchmarks that would run out of state.
+static void sweep(struct Bench* bench, size_t ops) {
+  double base_mops = 0;
+  for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+    size_t thread_ops = ops;
+    if (bench->run == run_reserve) {
+      // Every reservation takes fresh seats, so the events bound the run
+      size_t capacity = (size_t)bench->events * (bench->rows * bench->cols / bench->seats);
+      thread_ops = capacity / threads < ops ? capacity / threads : ops;
+    }
+    if (thread_ops == 0) {
+      continue;
+    }
+
+    uint64_t elapsed = measure(bench, threads, thread_ops);
+    double total_ops = (double)thread_ops * threads;
+    double mops = total_ops / ((double)elapsed / 1e3);
+    if (threads == 1) {
+      base_mops = mops;
+    }
+
+    printf("%s,%u,%zu,%zu,%zu,%u,%.0f,%.1f,%.3f,%.2f\n", bench->name, bench->events, bench->rows, bench->cols,
+           bench->seats, threads, total_ops, (double)elapsed * threads / total_ops, mops,
+           base_mops > 0 ? mops / base_mops : 0.0);
+    fflush(stdout);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+    char* end;
+    unsigned long value = 0;
+    switch (opt) {
+      case 'n':
+      case 't':
+        value = strtoul(optarg, &end, 10);
+        if (*end == '\0' && value != 0 && (opt == 'n' || value <= MAX_THREADS)) {
+          break;
+        }
+        // fall through
+      default:
+        fprintf(stderr,
+                "Usage: %s [-n ops_per_thread] [-t max_threads]\n"
+                "Prints one CSV row per benchmark and thread count; ns_per_op is thread time per operation\n"
+                "and speedup is the throughput relative to one thread.\n",
+                argv[0]);
+        return 1;
+    }
+    if (opt == 'n') {
+      ops_per_thread = (size_t)value;
+    } else {
+      max_threads = (unsigned int)value;
+    }
+  }
+
+  // ems_create goes through the simulated state access, whose nanosleep costs the
+  // timer slack even with no delay, so its rows are dominated by that wait
+  printf("# create rows include the state access sleep of ems_create (timer slack, tens of us), not index cost\n");
+  printf("bench,events,rows,cols,seats,threads,ops,ns_per_op,mops,speedup\n");
+
+  static const unsigned int event_counts[] = {16, 1024, 65536};
+  for (size_t i = 0; i < sizeof(event_counts) / sizeof(event_counts[0]); i++) {
+    struct Bench bench = {"get_event", run_get_event, setup_list, teardown_list, event_counts[i], 1, 1, 1, 0, NULL};
+    sweep(&bench, ops_per_thread);
+  }
+
+  static const size_t grids[][2] = {{10, 10}, {100, 100}};
+  for (size_t g = 0; g < sizeof(grids) / sizeof(grids[0]); g++) {
+    struct Bench bench = {"create", run_create, setup_events, teardown_events, 0, grids[g][0], grids[g][1], 1, 0, NULL};
+    // Every operation keeps a fresh grid alive until teardown, so bigger grids run fewer
+    sweep(&bench, ops_per_thread / (10 * grids[g][0]));
+  }
+
+  // One hot event against as many events as the session cache holds
+  static const unsigned int reserve_events[] = {1, EVENT_CACHE_SIZE};
+  static const size_t reserve_grids[][2] = {{100, 100}, {1000, 1000}};
+  static const size_t reserve_seats[] = {1, 16, MAX_RESERVATION_SIZE};
+  for (size_t e = 0; e < sizeof(reserve_events) / sizeof(reserve_events[0]); e++) {
+    for (size_t g = 0; g < sizeof(reserve_grids) / sizeof(reserve_grids[0]); g++) {
+      for (size_t s = 0; s < sizeof(reserve_seats) / sizeof(reserve_seats[0]); s++) {
+        struct Bench bench = {"reserve",           run_reserve,         setup_events,      teardown_events,
+                              reserve_events[e],   reserve_grids[g][0], reserve_grids[g][1], reserve_seats[s],
+                              0,                   NULL};
+        sweep(&bench, ops_per_thread);
+      }
+    }
+  }
+
+  static const size_t show_grids[][2] = {{10, 10}, {100, 100}, {1000, 1000}};
+  for (size_t g = 0; g < sizeof(show_grids) / sizeof(show_grids[0]); g++) {
+    struct Bench bench = {"show", run_show, setup_events, teardown_events, EVENT_CACHE_SIZE, show_grids[g][0],
+                          show_grids[g][1], 1, 0, NULL};
+    sweep(&bench, g == 2 ? ops_per_thread / 100 : ops_per_thread / 10);
+  }
+
+  return 0;
+}
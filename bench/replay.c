@@ -0,0 +1,476 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "client/api.h"
+#include "common/constants.h"
+#include "common/io.h"
+#include "server/trace.h"
+
+#define NUM_OPS 6
+#define PATH_SIZE 128
+
+// Requests a trace can hold, in the order they are reported
+enum ReplayOp { OP_CREATE, OP_RESERVE, OP_SHOW, OP_LIST, OP_STATS, OP_RESERVE_ALL };
+
+static const char* op_names[NUM_OPS] = {"create", "reserve", "show", "list", "stats", "reserve_all"};
+
+// How the requests are paced
+enum ReplayMode {
+  MODE_TIMED,   // Each request is sent at its recorded time from the start of the trace
+  MODE_FAST,    // Requests are sent as soon as their session is free
+  MODE_SERIAL,  // One request at a time, in trace order, each answered before the next is sent
+};
+
+static const char* mode_names[] = {"timed", "fast", "serial"};
+
+// Parameters of a replay
+struct ReplayConfig {
+  const char* server_path;  // Server pipe or socket
+  const char* pipe_prefix;  // Prefix of the session pipes
+  const char* output_path;  // File the SHOW, LIST and STATS output is appended to, or NULL
+  enum ReplayMode mode;     // How the requests are paced
+};
+
+// Session of the trace being replayed by a child process
+struct Replayer {
+  int trace_id;    // Id of the session in the trace
+  pid_t pid;       // Process replaying the session
+  int request_fd;  // Pipe the records of the session are forwarded through
+  int ack_fd;      // Pipe the process answers each record through, in MODE_SERIAL
+};
+
+// Outcome of the requests of a session, as sent from a child to the parent
+struct ReplayResult {
+  uint64_t counts[NUM_OPS];    // Requests sent, per ReplayOp
+  uint64_t failures[NUM_OPS];  // Requests the server rejected, per ReplayOp
+};
+
+static void print_usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [-f | -d] [-o output_path] [-p pipe_prefix] <trace_path> <server_path>\n"
+          "  -f  Send the requests as fast as possible instead of at their recorded times\n"
+          "  -d  Send one request at a time, in trace order, waiting for each answer, so\n"
+          "      runs against the same initial state give the same results\n"
+          "  -o  Append the output of SHOW, LIST and STATS requests to this file\n"
+          "  -p  Prefix of the session pipes (default: /tmp/ems_replay)\n"
+          "Traces are recorded with ems -T. Results are printed to stdout as one JSON object.\n",
+          program);
+}
+
+/// Gets the current instant.
+/// @return Nanoseconds on CLOCK_MONOTONIC.
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/// Sleeps until the given instant.
+/// @param deadline Instant on CLOCK_MONOTONIC, in nanoseconds.
+static void sleep_until(uint64_t deadline) {
+  struct timespec until = {(time_t)(deadline / 1000000000u), (long)(deadline % 1000000000u)};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+  }
+}
+
+/// Decodes a varint of a record that must fit an unsigned int.
+/// @return 0 if the value was decoded successfully, 1 otherwise.
+static int get_uint(struct Frame* record, unsigned int* value) {
+  uint64_t decoded;
+  if (frame_get_varint(record, &decoded) != 0 || decoded > UINT32_MAX) {
+    return 1;
+  }
+  *value = (unsigned int)decoded;
+  return 0;
+}
+
+/// Decodes a varint of a record that must fit a size_t.
+/// @return 0 if the value was decoded successfully, 1 otherwise.
+static int get_size(struct Frame* record, size_t* value) {
+  uint64_t decoded;
+  if (frame_get_varint(record, &decoded) != 0 || decoded > SIZE_MAX) {
+    return 1;
+  }
+  *value = (size_t)decoded;
+  return 0;
+}
+
+/// Sends the request of a record to the server through the session of the calling process.
+/// @param record Record positioned after its session id.
+/// @param output_fd File the output of SHOW, LIST and STATS goes to.
+/// @param result Counters to update.
+/// @return 0 if the request was sent, 1 if the record is malformed or of an unknown request.
+static int replay_record(struct Frame* record, int output_fd, struct ReplayResult* result) {
+  unsigned int event_id;
+  size_t num_rows, num_cols, num_seats, num_events;
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  unsigned int event_ids[MAX_TRANSACTION_EVENTS];
+  size_t event_seats[MAX_TRANSACTION_EVENTS];
+  enum ReplayOp op;
+  int ret;
+
+  switch (record->op_code) {
+    case '3':
+      if (get_uint(record, &event_id) != 0 || get_size(record, &num_rows) != 0 || get_size(record, &num_cols) != 0) {
+        return 1;
+      }
+      op = OP_CREATE;
+      ret = ems_create(event_id, num_rows, num_cols);
+      break;
+
+    case '4':
+      if (get_uint(record, &event_id) != 0 || get_size(record, &num_seats) != 0 || num_seats > MAX_RESERVATION_SIZE) {
+        return 1;
+      }
+      for (size_t i = 0; i < num_seats; i++) {
+        if (get_size(record, &xs[i]) != 0 || get_size(record, &ys[i]) != 0) {
+          return 1;
+        }
+      }
+      op = OP_RESERVE;
+      ret = ems_reserve(event_id, num_seats, xs, ys);
+      break;
+
+    case 'M':
+      if (get_size(record, &num_events) != 0 || num_events > MAX_TRANSACTION_EVENTS) {
+        return 1;
+      }
+      // The seats of every event follow those of the previous one
+      num_seats = 0;
+      for (size_t e = 0; e < num_events; e++) {
+        if (get_uint(record, &event_ids[e]) != 0 || get_size(record, &event_seats[e]) != 0 ||
+            event_seats[e] > MAX_RESERVATION_SIZE - num_seats) {
+          return 1;
+        }
+        for (size_t i = num_seats; i < num_seats + event_seats[e]; i++) {
+          if (get_size(record, &xs[i]) != 0 || get_size(record, &ys[i]) != 0) {
+            return 1;
+          }
+        }
+        num_seats += event_seats[e];
+      }
+      op = OP_RESERVE_ALL;
+      ret = ems_reserve_all(num_events, event_ids, event_seats, xs, ys);
+      break;
+
+    case '5':
+      if (get_uint(record, &event_id) != 0) {
+        return 1;
+      }
+      op = OP_SHOW;
+      ret = ems_show(output_fd, event_id);
+      break;
+
+    case '6':
+      op = OP_LIST;
+      ret = ems_list_events(output_fd);
+      break;
+
+    case '9':
+      op = OP_STATS;
+      ret = ems_stats(output_fd);
+      break;
+
+    default:
+      return 1;
+  }
+
+  result->counts[op]++;
+  result->failures[op] += ret != 0;
+  return 0;
+}
+
+/// Replays the records of one session as they are forwarded by the parent, then
+/// reports the outcome.
+/// @param config Parameters of the replay.
+/// @param index Index of the session among those replayed, which names its pipes.
+/// @param request_fd Pipe the records are read from, closed at the end of the session.
+/// @param ack_fd Pipe each record is answered through in MODE_SERIAL.
+/// @param result_fd Pipe to send the ReplayResult through.
+/// @return Exit status of the session process.
+static int run_session(const struct ReplayConfig* config, unsigned int index, int request_fd, int ack_fd,
+                       int result_fd) {
+  int output_fd = config->output_path != NULL ? open(config->output_path, O_WRONLY | O_CREAT | O_APPEND, 0664)
+                                              : open("/dev/null", O_WRONLY);
+  struct Frame record;
+  if (output_fd == -1 || frame_init(&record) != 0) {
+    fprintf(stderr, "Failed to prepare session %u\n", index);
+    return 1;
+  }
+
+  char req_path[PATH_SIZE], resp_path[PATH_SIZE];
+  snprintf(req_path, sizeof(req_path), "%s_%d_%u_req", config->pipe_prefix, (int)getpid(), index);
+  snprintf(resp_path, sizeof(resp_path), "%s_%d_%u_resp", config->pipe_prefix, (int)getpid(), index);
+  if (ems_setup(req_path, resp_path, config->server_path) != 0) {
+    fprintf(stderr, "Failed to open session %u\n", index);
+    return 1;
+  }
+
+  struct ReplayResult result = {{0}, {0}};
+  char ack = 0;
+  int status = 0;
+  while (read_frame(request_fd, &record) == READ_OK) {
+    // The parent already used the delay and the session id
+    uint64_t skipped;
+    if (frame_get_varint(&record, &skipped) != 0 || frame_get_varint(&record, &skipped) != 0 ||
+        replay_record(&record, output_fd, &result) != 0) {
+      fprintf(stderr, "Invalid record in session %u\n", index);
+      status = 1;
+      break;
+    }
+    if (config->mode == MODE_SERIAL && write_str(ack_fd, &ack, 1) != 0) {
+      status = 1;
+      break;
+    }
+  }
+
+  ems_quit();
+  frame_free(&record);
+
+  if (write_str(result_fd, (char*)&result, sizeof(result)) != 0) {
+    fprintf(stderr, "Failed to report session %u\n", index);
+    return 1;
+  }
+  return status;
+}
+
+/// Starts a process that replays a session of the trace.
+/// @param config Parameters of the replay.
+/// @param replayers Sessions being replayed, whose pipes the new process must not hold.
+/// @param count Number of sessions being replayed.
+/// @param index Index of the new session among all those replayed.
+/// @param trace_id Id of the session in the trace.
+/// @param trace_fd Descriptor of the trace, which the new process must not hold either.
+/// @param result_fd Pipe the process reports through.
+/// @param replayer Replayer to fill in.
+/// @return 0 if the process was started successfully, 1 otherwise.
+static int start_session(const struct ReplayConfig* config, struct Replayer* replayers, size_t count,
+                         unsigned int index, int trace_id, int trace_fd, int result_fd, struct Replayer* replayer) {
+  int request_pipe[2], ack_pipe[2];
+  if (pipe(request_pipe) != 0) {
+    return 1;
+  }
+  if (pipe(ack_pipe) != 0) {
+    close(request_pipe[0]);
+    close(request_pipe[1]);
+    return 1;
+  }
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    close(request_pipe[0]);
+    close(request_pipe[1]);
+    close(ack_pipe[0]);
+    close(ack_pipe[1]);
+    return 1;
+  }
+  if (pid == 0) {
+    // A sibling only sees the end of its records once no other process holds its pipe
+    for (size_t i = 0; i < count; i++) {
+      close(replayers[i].request_fd);
+      close(replayers[i].ack_fd);
+    }
+    close(trace_fd);
+    close(request_pipe[1]);
+    close(ack_pipe[0]);
+    exit(run_session(config, index, request_pipe[0], ack_pipe[1], result_fd));
+  }
+
+  close(request_pipe[0]);
+  close(ack_pipe[1]);
+  *replayer = (struct Replayer){trace_id, pid, request_pipe[1], ack_pipe[0]};
+  return 0;
+}
+
+/// Ends the replay of a session, which quits once it has sent the records already forwarded.
+/// @param replayers Sessions being replayed.
+/// @param count Number of sessions being replayed, decremented.
+/// @param i Index of the session to end.
+static void end_session(struct Replayer* replayers, size_t* count, size_t i) {
+  close(replayers[i].request_fd);
+  close(replayers[i].ack_fd);
+  replayers[i] = replayers[--*count];
+}
+
+int main(int argc, char* argv[]) {
+  struct ReplayConfig config = {.pipe_prefix = "/tmp/ems_replay", .mode = MODE_TIMED};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "fdo:p:")) != -1) {
+    switch (opt) {
+      case 'f':
+        config.mode = MODE_FAST;
+        break;
+      case 'd':
+        config.mode = MODE_SERIAL;
+        break;
+      case 'o':
+        config.output_path = optarg;
+        break;
+      case 'p':
+        config.pipe_prefix = optarg;
+        break;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  config.server_path = argv[optind + 1];
+
+  int trace_fd = open(argv[optind], O_RDONLY);
+  struct Channel trace;
+  struct Frame record;
+  if (trace_fd == -1 || channel_init(&trace, trace_fd, -1) != 0 || frame_init(&record) != 0) {
+    fprintf(stderr, "Failed to open trace\n");
+    return 1;
+  }
+
+  uint64_t version;
+  if (channel_get_frame(&trace, &record, FRAME_MAX_BODY_SIZE) != READ_OK || record.op_code != TRACE_OP_HEADER ||
+      frame_get_varint(&record, &version) != 0 || version != TRACE_VERSION) {
+    fprintf(stderr, "Not a trace of version %d\n", TRACE_VERSION);
+    return 1;
+  }
+
+  int result_pipe[2];
+  if (pipe(result_pipe) != 0) {
+    fprintf(stderr, "Failed to create pipe\n");
+    return 1;
+  }
+
+  struct Replayer* replayers = NULL;
+  size_t active = 0, capacity = 0;
+  unsigned int started = 0;
+  uint64_t records = 0, max_lag_ns = 0, offset_ns = 0;
+  int status = 0;
+
+  uint64_t start = now_ns();
+  enum ReadStatus read_status;
+  while ((read_status = channel_get_frame(&trace, &record, FRAME_MAX_BODY_SIZE)) == READ_OK) {
+    uint64_t delay_ns, trace_id;
+    if (frame_get_varint(&record, &delay_ns) != 0 || frame_get_varint(&record, &trace_id) != 0 ||
+        trace_id > INT32_MAX) {
+      fprintf(stderr, "Malformed record %llu\n", (unsigned long long)records);
+      status = 1;
+      break;
+    }
+    records++;
+    offset_ns += delay_ns;
+
+    size_t i = 0;
+    while (i < active && replayers[i].trace_id != (int)trace_id) {
+      i++;
+    }
+
+    if (record.op_code == '2') {
+      if (i < active) {
+        end_session(replayers, &active, i);
+      }
+      continue;
+    }
+
+    if (config.mode == MODE_TIMED) {
+      uint64_t now = now_ns();
+      if (now < start + offset_ns) {
+        sleep_until(start + offset_ns);
+      } else if (now - start - offset_ns > max_lag_ns) {
+        max_lag_ns = now - start - offset_ns;
+      }
+    }
+
+    if (i == active) {
+      if (active == capacity) {
+        capacity = capacity > 0 ? capacity * 2 : 16;
+        struct Replayer* grown = realloc(replayers, capacity * sizeof(struct Replayer));
+        if (grown == NULL) {
+          fprintf(stderr, "Failed to allocate sessions\n");
+          status = 1;
+          break;
+        }
+        replayers = grown;
+      }
+      if (start_session(&config, replayers, active, started, (int)trace_id, trace_fd, result_pipe[1],
+                        &replayers[active]) != 0) {
+        fprintf(stderr, "Failed to start session %u\n", started);
+        status = 1;
+        break;
+      }
+      active++;
+      started++;
+    }
+
+    char ack;
+    if (write_frame(replayers[i].request_fd, &record) != 0 ||
+        (config.mode == MODE_SERIAL && read(replayers[i].ack_fd, &ack, 1) != 1)) {
+      fprintf(stderr, "Session %d of the trace stopped replaying\n", replayers[i].trace_id);
+      end_session(replayers, &active, i);
+      status = 1;
+    }
+  }
+  if (read_status == READ_ERROR) {
+    fprintf(stderr, "Trace is truncated\n");
+    status = 1;
+  }
+
+  // Sessions still open when the trace ends quit once their records are sent
+  while (active > 0) {
+    end_session(replayers, &active, active - 1);
+  }
+  close(result_pipe[1]);
+
+  struct ReplayResult total = {{0}, {0}}, result;
+  unsigned int reported = 0;
+  // Results are shorter than PIPE_BUF, so each one is written and read whole
+  while (read(result_pipe[0], &result, sizeof(result)) == (ssize_t)sizeof(result)) {
+    for (int op = 0; op < NUM_OPS; op++) {
+      total.counts[op] += result.counts[op];
+      total.failures[op] += result.failures[op];
+    }
+    reported++;
+  }
+  close(result_pipe[0]);
+  uint64_t elapsed = now_ns() - start;
+
+  int child_status;
+  while (wait(&child_status) > 0) {
+    if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+      status = 1;
+    }
+  }
+  if (reported != started) {
+    status = 1;
+  }
+
+  double elapsed_s = (double)elapsed / 1e9;
+  uint64_t requests = 0;
+  for (int op = 0; op < NUM_OPS; op++) {
+    requests += total.counts[op];
+  }
+
+  printf("{\"mode\":\"%s\",\"records\":%llu,\"sessions\":%u,\"requests\":%llu,\"trace_s\":%.6f,\"elapsed_s\":%.6f,"
+         "\"throughput_rps\":%.1f,\"max_lag_us\":%.1f,\"ops\":{",
+         mode_names[config.mode], (unsigned long long)records, started, (unsigned long long)requests,
+         (double)offset_ns / 1e9, elapsed_s, (double)requests / elapsed_s, (double)max_lag_ns / 1e3);
+  for (int op = 0; op < NUM_OPS; op++) {
+    printf("%s\"%s\":{\"count\":%llu,\"failed\":%llu}", op > 0 ? "," : "", op_names[op],
+           (unsigned long long)total.counts[op], (unsigned long long)total.failures[op]);
+  }
+  printf("}}\n");
+
+  free(replayers);
+  frame_free(&record);
+  channel_free(&trace);
+  close(trace_fd);
+  return status;
+}
@@ -1,307 +1,543 @@
-#include <errno.h>
 #include <stdio.h>
-#include <fcntl.h>
-#include <string.h>
 #include <sys/types.h>
 #include <stddef.h>
-#include <unistd.h>
-#include <sys/stat.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "api.h"
 #include "common/constants.h"
 #include "common/io.h"
+#include "common/ring.h"
+#include "transport.h"
+
+#define SHOW_BUFFER_SIZE 65536
 
 int session_id;
-int req_pipe_fd;
-int resp_pipe_fd;
-int server_pipe_fd;
+const struct Transport* transport;
+struct Connection connection;
+struct Channel channel;  // Requests and responses over the connection
 
-int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path) {
-  // Unlink pipes
-  unlink(req_pipe_path);
-  unlink(resp_pipe_path);
+struct Frame request_frame;   // Request being encoded
+struct Frame response_frame;  // Last response read
 
-  // Create pipes
-  if (mkfifo(req_pipe_path, 0664) != 0) {
-    fprintf(stderr, "Failed to create pipe\n");
+struct Frame batch_frame;        // Batch being built
+char batch_ops[MAX_BATCH_SIZE];  // Opcodes of the requests in the batch
+size_t batch_count = 0;          // Number of requests in the batch
+
+/// Writes the opcode and session id that start a request of the fixed-width protocol,
+/// which is only used to negotiate the framed one.
+/// @param op_code Opcode of the request.
+/// @return 0 if the header was written successfully, 1 otherwise.
+static int write_header(char op_code) {
+  if(channel_put(&channel, &op_code, sizeof(char)) != 0 || channel_put_int(&channel, session_id) != 0){
+    fprintf(stderr, "Failed to write to pipe\n");
     return 1;
   }
-  if (mkfifo(resp_pipe_path, 0664) != 0) {
-    fprintf(stderr, "Failed to create pipe\n");
-    unlink(req_pipe_path);
+  return 0;
+}
+
+/// Starts encoding a request.
+/// @param op_code Opcode of the request.
+static void begin_request(char op_code) { frame_reset(&request_frame, op_code, 0); }
+
+/// Encodes the arguments of a CREATE request.
+static int put_create_args(struct Frame* frame, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if(frame_put_varint(frame, event_id) != 0 || frame_put_varint(frame, num_rows) != 0 ||
+     frame_put_varint(frame, num_cols) != 0){
+    fprintf(stderr, "Failed to encode request\n");
     return 1;
   }
+  return 0;
+}
+
+/// Encodes coordinates as differences to the previous one, which are small for
+/// the neighbouring seats a reservation usually asks for.
+static int put_coordinates(struct Frame* frame, size_t count, size_t* coordinates) {
+  int64_t previous = 0;
+  for(size_t i = 0; i < count; i++){
+    if(frame_put_svarint(frame, (int64_t)coordinates[i] - previous) != 0){
+      return 1;
+    }
+    previous = (int64_t)coordinates[i];
+  }
+  return 0;
+}
 
-  // Open server pipe for writing. It waits until the server opens it for reading
-  server_pipe_fd = open(server_pipe_path, O_WRONLY);
-  if (server_pipe_fd == -1) {
-    fprintf(stderr, "Failed to open pipe\n");
-    unlink(req_pipe_path);
-    unlink(resp_pipe_path);
+/// Encodes the arguments of a RESERVE request.
+static int put_reserve_args(struct Frame* frame, unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  if(frame_put_varint(frame, event_id) != 0 || frame_put_varint(frame, num_seats) != 0 ||
+     put_coordinates(frame, num_seats, xs) != 0 || put_coordinates(frame, num_seats, ys) != 0){
+    fprintf(stderr, "Failed to encode request\n");
     return 1;
   }
+  return 0;
+}
 
-  // Create register message
-  char register_msg[1 + 2 * PIPE_NAME_SIZE];
-  memset(register_msg, '\0', sizeof(register_msg));
-  register_msg[0] = '1';
-  strncpy(register_msg + 1, req_pipe_path, strlen(req_pipe_path));
-  strncpy(register_msg + 1 + PIPE_NAME_SIZE, resp_pipe_path, strlen(resp_pipe_path));
+/// Encodes the arguments of a RESERVE_ALL request: the number of events, then the
+/// arguments of a RESERVE for each of them.
+static int put_reserve_all_args(struct Frame* frame, size_t num_events, unsigned int* event_ids, size_t* num_seats,
+                                size_t* xs, size_t* ys) {
+  if(frame_put_varint(frame, num_events) != 0){
+    fprintf(stderr, "Failed to encode request\n");
+    return 1;
+  }
+  size_t offset = 0;
+  for(size_t i = 0; i < num_events; i++){
+    if(put_reserve_args(frame, event_ids[i], num_seats[i], xs + offset, ys + offset) != 0){
+      return 1;
+    }
+    offset += num_seats[i];
+  }
+  return 0;
+}
 
-  // Write to server pipe
-  if (write_str(server_pipe_fd, register_msg, sizeof(register_msg)) != 0){
+/// Queues the request that was encoded. It is sent when a response is awaited,
+/// so requests submitted back to back share a write.
+/// @return 0 if the request was queued successfully, 1 otherwise.
+static int send_request(void) {
+  if(channel_put_frame(&channel, &request_frame) != 0){
     fprintf(stderr, "Failed to write to pipe\n");
-    close(server_pipe_fd);
-    unlink(req_pipe_path);
-    unlink(resp_pipe_path);
     return 1;
   }
+  return 0;
+}
 
-  // Open client pipes
-  resp_pipe_fd = open(resp_pipe_path, O_RDONLY);
-  if (resp_pipe_fd == -1) {
-    fprintf(stderr, "Failed to open pipe\n");
-    close(server_pipe_fd);
-    unlink(req_pipe_path);
-    unlink(resp_pipe_path);
+/// Decodes a status or size from the response.
+/// @return 0 if the value was decoded successfully, 1 otherwise.
+static int get_response_value(size_t* value) {
+  uint64_t decoded;
+  if(frame_get_varint(&response_frame, &decoded) != 0 || decoded > SIZE_MAX){
+    fprintf(stderr, "Malformed response\n");
     return 1;
   }
-  req_pipe_fd = open(req_pipe_path, O_WRONLY);
-  if (req_pipe_fd == -1) {
-    fprintf(stderr, "Failed to open pipe\n");
-    close(server_pipe_fd);
-    close(resp_pipe_fd);
-    unlink(req_pipe_path);
-    unlink(resp_pipe_path);
+  *value = (size_t)decoded;
+  return 0;
+}
+
+/// Reads the response to a request.
+/// @param op_code Opcode of the request.
+/// @param ret Pointer to the variable to store the status of the request in.
+/// @return 0 if the response was read successfully, 1 otherwise.
+static int read_response(char op_code, int* ret) {
+  if(channel_flush(&channel) != 0){
+    fprintf(stderr, "Failed to write to pipe\n");
     return 1;
   }
-
-  // Read session_id from response pipe
-  if(read_int(resp_pipe_fd, &session_id) != 0) {
+  if(channel_get_frame(&channel, &response_frame, FRAME_MAX_BODY_SIZE) != READ_OK){
     fprintf(stderr, "Failed to read from pipe\n");
-    close(server_pipe_fd);
-    close(resp_pipe_fd);
-    close(req_pipe_fd);
-    unlink(req_pipe_path);
-    unlink(resp_pipe_path);
     return 1;
   }
-
-  if(close(server_pipe_fd) != 0){
-    fprintf(stderr, "Failed to close pipe\n");
-    close(resp_pipe_fd);
-    close(req_pipe_fd);
-    unlink(req_pipe_path);
-    unlink(resp_pipe_path);
+  if(response_frame.op_code != op_code || response_frame.flags != 0){
+    fprintf(stderr, "Unexpected response\n");
     return 1;
   }
 
+  size_t status;
+  if(get_response_value(&status) != 0){
+    return 1;
+  }
+  *ret = status != 0;
   return 0;
 }
 
-int ems_quit(void) {
-  if(write_str(req_pipe_fd, "2", sizeof(char)) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path) {
+  transport = select_transport(server_pipe_path);
+
+  if (transport->connect(req_pipe_path, resp_pipe_path, server_pipe_path, &connection) != 0) {
     return 1;
   }
 
-  if(write_int(req_pipe_fd, &session_id) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+  if(channel_init(&channel, connection.resp_fd, connection.req_fd) != 0){
+    fprintf(stderr, "Failed to allocate channel\n");
+    transport->disconnect(&connection);
     return 1;
   }
+  if(connection.shm != NULL){
+    channel_attach_rings(&channel, &connection.shm->response, &connection.shm->request);
+  }
 
-  // Close pipes
-  if(close(resp_pipe_fd) != 0){
-    fprintf(stderr, "Failed to close pipe\n");
+  // Read session_id from response pipe
+  if(channel_get_int(&channel, &session_id) != 0) {
+    fprintf(stderr, "Failed to read from pipe\n");
+    channel_free(&channel);
+    transport->disconnect(&connection);
     return 1;
   }
 
-  if(close(req_pipe_fd) != 0){
-    fprintf(stderr, "Failed to close pipe\n");
+  // Ask for the framed protocol, which every later request uses
+  unsigned int version = PROTOCOL_VERSION;
+  if(write_header('0') != 0 || channel_put_uint(&channel, version) != 0 || channel_flush(&channel) != 0 ||
+     channel_get_uint(&channel, &version) != 0){
+    fprintf(stderr, "Failed to negotiate protocol\n");
+    channel_free(&channel);
+    transport->disconnect(&connection);
     return 1;
   }
-  
+  if(version != PROTOCOL_VERSION){
+    fprintf(stderr, "Server does not support protocol version %d\n", PROTOCOL_VERSION);
+    channel_free(&channel);
+    transport->disconnect(&connection);
+    return 1;
+  }
+
+  if((request_frame.data == NULL && frame_init(&request_frame) != 0) ||
+     (response_frame.data == NULL && frame_init(&response_frame) != 0)){
+    fprintf(stderr, "Failed to allocate frames\n");
+    channel_free(&channel);
+    transport->disconnect(&connection);
+    return 1;
+  }
+
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
-  if(write_str(req_pipe_fd, "3", sizeof(char)) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+int ems_quit(void) {
+  begin_request('2');
+  if(send_request() != 0){
     return 1;
   }
-  if(write_int(req_pipe_fd, &session_id) != 0){
+  if(channel_flush(&channel) != 0){
     fprintf(stderr, "Failed to write to pipe\n");
     return 1;
   }
-  if(write_uint(req_pipe_fd, &event_id) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+
+  frame_free(&request_frame);
+  frame_free(&response_frame);
+  frame_free(&batch_frame);
+  batch_count = 0;
+  channel_free(&channel);
+  return transport->disconnect(&connection);
+}
+
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  begin_request('3');
+  if(put_create_args(&request_frame, event_id, num_rows, num_cols) != 0 || send_request() != 0){
     return 1;
   }
-  if(write_sizet(req_pipe_fd, &num_rows) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+  
+  int ret;
+  if(read_response('3', &ret) != 0){
     return 1;
   }
-  if(write_sizet(req_pipe_fd, &num_cols) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+  return ret;
+}
+
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  begin_request('4');
+  if(put_reserve_args(&request_frame, event_id, num_seats, xs, ys) != 0 || send_request() != 0){
     return 1;
   }
-  
+
   int ret;
-  if(read_int(resp_pipe_fd, &ret) != 0){
-    fprintf(stderr, "Failed to read from pipe\n");
+  if(read_response('4', &ret) != 0){
     return 1;
   }
   return ret;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
-  if(write_str(req_pipe_fd, "4", sizeof(char)) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+int ems_reserve_all(size_t num_events, unsigned int* event_ids, size_t* num_seats, size_t* xs, size_t* ys) {
+  begin_request('M');
+  if(put_reserve_all_args(&request_frame, num_events, event_ids, num_seats, xs, ys) != 0 || send_request() != 0){
     return 1;
   }
-  if(write_int(req_pipe_fd, &session_id) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+
+  int ret;
+  if(read_response('M', &ret) != 0){
     return 1;
   }
-  if(write_uint(req_pipe_fd, &event_id) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+  return ret;
+}
+
+/// Writes out the seats buffered by print_seats once another seat may not fit.
+/// @param out_fd File descriptor to print the seats to.
+/// @param out_buf Buffer holding the seats.
+/// @param len Pointer to the number of bytes buffered, reset once they are written.
+/// @return 0 if there was room or the seats were written successfully, 1 otherwise.
+static int flush_seats(int out_fd, char* out_buf, size_t* len) {
+  if(*len <= SHOW_BUFFER_SIZE - 11){
+    return 0;
+  }
+  if(write_str(out_fd, out_buf, *len) != 0){
+    fprintf(stderr, "Failed to write to file\n");
     return 1;
   }
-  if(write_sizet(req_pipe_fd, &num_seats) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+  *len = 0;
+  return 0;
+}
+
+/// Prints the seats of an event decoded from the response to a SHOW request.
+/// @param out_fd File descriptor to print the event to.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+static int print_seats(int out_fd) {
+  size_t num_rows, num_cols;
+  if(get_response_value(&num_rows) != 0 || get_response_value(&num_cols) != 0){
     return 1;
   }
-  for(size_t i = 0; i < num_seats; i++){
-    if(write_sizet(req_pipe_fd, xs + i) != 0){
-      fprintf(stderr, "Failed to write to pipe\n");
-      return 1;
+
+  // Decode the seats straight into a buffer that is flushed whenever it may not fit another seat
+  char out_buf[SHOW_BUFFER_SIZE];
+  size_t len = 0;
+  for(size_t i = 0; i < num_rows; i++){
+    // Every row ends its line, even in an event without columns
+    if(num_cols == 0){
+      if(flush_seats(out_fd, out_buf, &len) != 0){
+        return 1;
+      }
+      out_buf[len++] = '\n';
+      continue;
     }
-  }
-  for(size_t i = 0; i < num_seats; i++){
-    if(write_sizet(req_pipe_fd, ys + i) != 0){
-      fprintf(stderr, "Failed to write to pipe\n");
-      return 1;
+
+    for(size_t j = 0; j < num_cols; j++){
+      if(flush_seats(out_fd, out_buf, &len) != 0){
+        return 1;
+      }
+
+      size_t seat;
+      if(get_response_value(&seat) != 0){
+        return 1;
+      }
+      len += format_uint(out_buf + len, (unsigned int)seat);
+      out_buf[len++] = j + 1 < num_cols ? ' ' : '\n';
     }
   }
 
-  int ret;
-  if(read_int(resp_pipe_fd, &ret) != 0){
-    fprintf(stderr, "Failed to read from pipe\n");
+  if(write_str(out_fd, out_buf, len) != 0){
+    fprintf(stderr, "Failed to write to file\n");
     return 1;
   }
-  return ret;
+  return 0;
 }
 
 int ems_show(int out_fd, unsigned int event_id) {
-  if(write_str(req_pipe_fd, "5", sizeof(char)) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
-    return 1;
-  }
-  if(write_int(req_pipe_fd, &session_id) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
-    return 1;
-  }
-  if(write_uint(req_pipe_fd, &event_id) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+  begin_request('5');
+  if(frame_put_varint(&request_frame, event_id) != 0 || send_request() != 0){
     return 1;
   }
   
   int ret;
-  if(read_int(resp_pipe_fd, &ret) != 0){
-    fprintf(stderr, "Failed to read from pipe\n");
+  if(read_response('5', &ret) != 0){
     return 1;
   }
   if(ret != 0){
     return 1;
   }
-  
-  size_t num_rows, num_cols;
-  
-  if(read_sizet(resp_pipe_fd, &num_rows) != 0){
-    fprintf(stderr, "Failed to read from pipe\n");
+  return print_seats(out_fd);
+}
+
+/// Prints the ids decoded from the response to a LIST request.
+/// @param out_fd File descriptor to print the ids to.
+/// @return 0 if the ids were printed successfully, 1 otherwise.
+static int print_events(int out_fd) {
+  size_t num_events;
+  if(get_response_value(&num_events) != 0){
     return 1;
   }
-  if(read_sizet(resp_pipe_fd, &num_cols) != 0){
-    fprintf(stderr, "Failed to read from pipe\n");
-    return 1;
+
+  if(num_events == 0){
+    if(print_str(out_fd, "No events\n")) {
+      fprintf(stderr, "Failed to write to file\n");
+      return 1;
+    }
+    return 0;
   }
 
-  for(size_t i = 1; i <= num_rows; i++){
-    for(size_t j = 1; j <= num_cols; j++){
-      unsigned int seat;
-      if(read_uint(resp_pipe_fd, &seat) != 0){
-        fprintf(stderr, "Failed to read from pipe\n");
-        return 1;
-      }
-      if(print_uint(out_fd, seat) != 0){
+  // Ids arrive as differences to the previous one
+  char out_buf[SHOW_BUFFER_SIZE];
+  size_t len = 0;
+  int64_t id = 0;
+  for(size_t i = 0; i < num_events; i++){
+    if(len > SHOW_BUFFER_SIZE - 18){
+      if(write_str(out_fd, out_buf, len) != 0){
         fprintf(stderr, "Failed to write to file\n");
         return 1;
       }
-
-      if (j < num_cols) {
-        if (print_str(out_fd, " ")) {
-          fprintf(stderr, "Failed to write to file\n");
-          return 1;
-        }
-      }
+      len = 0;
     }
-    if (print_str(out_fd, "\n")) {
-      fprintf(stderr, "Failed to write to file\n");
+
+    int64_t delta;
+    if(frame_get_svarint(&response_frame, &delta) != 0){
+      fprintf(stderr, "Malformed response\n");
       return 1;
     }
+    id += delta;
+
+    memcpy(out_buf + len, "Event: ", 7);
+    len += 7;
+    len += format_uint(out_buf + len, (unsigned int)id);
+    out_buf[len++] = '\n';
+  }
+
+  if(write_str(out_fd, out_buf, len) != 0){
+    fprintf(stderr, "Failed to write to file\n");
+    return 1;
   }
   return 0;
 }
 
 int ems_list_events(int out_fd) {
-  if(write_str(req_pipe_fd, "6", sizeof(char)) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+  begin_request('6');
+  if(send_request() != 0){
     return 1;
   }
-  if(write_int(req_pipe_fd, &session_id) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
+  
+  int ret;
+  if(read_response('6', &ret) != 0){
     return 1;
   }
-  
+  if(ret != 0){
+    return 1;
+  }
+  return print_events(out_fd);
+}
+
+int ems_stats(int out_fd) {
+  begin_request('9');
+  if(send_request() != 0){
+    return 1;
+  }
+
   int ret;
-  if(read_int(resp_pipe_fd, &ret) != 0){
-    fprintf(stderr, "Failed to read from pipe\n");
+  if(read_response('9', &ret) != 0){
     return 1;
   }
   if(ret != 0){
     return 1;
   }
-  
-  size_t num_events;
-  if(read_sizet(req_pipe_fd, &num_events) != 0){
-    fprintf(stderr, "Failed to read from pipe\n");
+
+  const void* report;
+  size_t len;
+  if(frame_get_bytes(&response_frame, &report, &len) != 0){
+    fprintf(stderr, "Malformed response\n");
     return 1;
   }
 
-  if(num_events == 0){
-    if(print_str(out_fd, "No events\n")) {
-      fprintf(stderr, "Failed to write to file\n");
-      return 1;
-    }
+  if(write_str(out_fd, (char*)report, len) != 0){
+    fprintf(stderr, "Failed to write to file\n");
+    return 1;
   }
-  else{
-    for(size_t i = 0; i < num_events; i++){
-      char event_str[9 + sizeof(unsigned int)];
+  return 0;
+}
 
-      unsigned int id;
-      if(read_uint(resp_pipe_fd, &id) != 0){
-        fprintf(stderr, "Failed to read from pipe\n");
-        return 1;
-      }
+/// Adds a request to the batch, starting the batch if it is empty.
+/// @param op_code Opcode of the request, whose arguments are encoded next.
+/// @return 0 if the request was added successfully, 1 otherwise.
+static int batch_add(char op_code) {
+  if(batch_count == MAX_BATCH_SIZE){
+    fprintf(stderr, "Batch is full\n");
+    return 1;
+  }
+  if(batch_frame.data == NULL && frame_init(&batch_frame) != 0){
+    fprintf(stderr, "Failed to allocate batch\n");
+    return 1;
+  }
+  if(batch_count == 0){
+    frame_reset(&batch_frame, 'B', 0);
+  }
+  if(frame_put_varint(&batch_frame, (uint64_t)op_code) != 0){
+    fprintf(stderr, "Failed to encode request\n");
+    return 1;
+  }
+  batch_ops[batch_count++] = op_code;
+  return 0;
+}
 
-      snprintf(event_str, 9 + sizeof(unsigned int), "Event: %d\n", id);
+/// Drops the last request added to the batch, whose arguments could not be encoded.
+/// @param len Length of the batch before the request was added.
+static void batch_drop(size_t len) {
+  batch_frame.len = len;
+  batch_count--;
+}
 
-      if(print_str(out_fd, event_str)) {
-        fprintf(stderr, "Failed to write to file\n");
-        return 1;
-      }
-    } 
+int ems_batch_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  size_t len = batch_count > 0 ? batch_frame.len : 0;
+  if(batch_add('3') != 0){
+    return 1;
+  }
+  if(put_create_args(&batch_frame, event_id, num_rows, num_cols) != 0){
+    batch_drop(len);
+    return 1;
+  }
+  return 0;
+}
+
+int ems_batch_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  size_t len = batch_count > 0 ? batch_frame.len : 0;
+  if(batch_add('4') != 0){
+    return 1;
+  }
+  if(put_reserve_args(&batch_frame, event_id, num_seats, xs, ys) != 0){
+    batch_drop(len);
+    return 1;
+  }
+  return 0;
+}
+
+int ems_batch_reserve_all(size_t num_events, unsigned int* event_ids, size_t* num_seats, size_t* xs, size_t* ys) {
+  size_t len = batch_count > 0 ? batch_frame.len : 0;
+  if(batch_add('M') != 0){
+    return 1;
+  }
+  if(put_reserve_all_args(&batch_frame, num_events, event_ids, num_seats, xs, ys) != 0){
+    batch_drop(len);
+    return 1;
+  }
+  return 0;
+}
+
+int ems_batch_show(unsigned int event_id) {
+  size_t len = batch_count > 0 ? batch_frame.len : 0;
+  if(batch_add('5') != 0){
+    return 1;
+  }
+  if(frame_put_varint(&batch_frame, event_id) != 0){
+    fprintf(stderr, "Failed to encode request\n");
+    batch_drop(len);
+    return 1;
+  }
+  return 0;
+}
+
+int ems_batch_list_events(void) { return batch_add('6'); }
+
+size_t ems_batch_size(void) { return batch_count; }
+
+int ems_batch_run(int out_fd, int* statuses) {
+  size_t count = batch_count;
+  batch_count = 0;
+  for(size_t i = 0; i < count; i++){
+    statuses[i] = 1;
+  }
+  if(count == 0){
+    return 0;
+  }
+
+  if(channel_put_frame(&channel, &batch_frame) != 0){
+    fprintf(stderr, "Failed to write to pipe\n");
+    return 1;
   }
 
+  int ret;
+  if(read_response('B', &ret) != 0 || ret != 0){
+    return 1;
+  }
+
+  // The statuses follow one another, each as the response to a single request would hold it
+  for(size_t i = 0; i < count; i++){
+    size_t status;
+    if(get_response_value(&status) != 0){
+      return 1;
+    }
+    if(status != 0){
+      continue;
+    }
+    if(batch_ops[i] == '5' && print_seats(out_fd) != 0){
+      return 1;
+    }
+    if(batch_ops[i] == '6' && print_events(out_fd) != 0){
+      return 1;
+    }
+    statuses[i] = 0;
+  }
   return 0;
 }
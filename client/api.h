@@ -4,9 +4,10 @@
 #include <stddef.h>
 
 /// Connects to an EMS server.
+/// @note If server_pipe_path is a Unix domain socket, the session goes through it and no pipes are created.
 /// @param req_pipe_path Path to the name pipe to be created for requests.
 /// @param resp_pipe_path Path to the name pipe to be created for responses.
-/// @param server_pipe_path Path to the name pipe where the server is listening.
+/// @param server_pipe_path Path to the name pipe or socket where the server is listening.
 /// @return 0 if the connection was established successfully, 1 otherwise.
 int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path);
 
@@ -29,6 +30,16 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
 
+/// Creates a reservation in each of the given events, either in all of them or in none.
+/// @param num_events Number of events, at most MAX_TRANSACTION_EVENTS, none of them repeated.
+/// @param event_ids Array of ids of the events to create a reservation for.
+/// @param num_seats Array of the number of seats to reserve in each event, at most
+/// MAX_RESERVATION_SIZE in all.
+/// @param xs Array of rows of the seats to reserve, those of each event after those of the previous one.
+/// @param ys Array of columns of the seats to reserve, in the same order as the rows.
+/// @return 0 if every reservation was created successfully, 1 otherwise.
+int ems_reserve_all(size_t num_events, unsigned int* event_ids, size_t* num_seats, size_t* xs, size_t* ys);
+
 /// Prints the given event to the given file.
 /// @param out_fd File descriptor to print the event to.
 /// @param event_id Id of the event to print.
@@ -40,4 +51,58 @@ int ems_show(int out_fd, unsigned int event_id);
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_list_events(int out_fd);
 
+/// Prints the request latency statistics of the server to the given file.
+/// @param out_fd File descriptor to print the statistics to.
+/// @return 0 if the statistics were printed successfully, 1 otherwise.
+int ems_stats(int out_fd);
+
+/// Adds a CREATE request to the batch being built.
+/// @note A batch is sent as a single message by ems_batch_run, which executes its
+/// requests in order and answers them all at once. At most MAX_BATCH_SIZE requests
+/// fit in a batch.
+/// @param event_id Id of the event to be created.
+/// @param num_rows Number of rows of the event to be created.
+/// @param num_cols Number of columns of the event to be created.
+/// @return 0 if the request was added successfully, 1 otherwise.
+int ems_batch_create(unsigned int event_id, size_t num_rows, size_t num_cols);
+
+/// Adds a RESERVE request to the batch being built.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return 0 if the request was added successfully, 1 otherwise.
+int ems_batch_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
+
+/// Adds a RESERVE_ALL request to the batch being built.
+/// @param num_events Number of events, at most MAX_TRANSACTION_EVENTS, none of them repeated.
+/// @param event_ids Array of ids of the events to create a reservation for.
+/// @param num_seats Array of the number of seats to reserve in each event.
+/// @param xs Array of rows of the seats to reserve, those of each event after those of the previous one.
+/// @param ys Array of columns of the seats to reserve, in the same order as the rows.
+/// @return 0 if the request was added successfully, 1 otherwise.
+int ems_batch_reserve_all(size_t num_events, unsigned int* event_ids, size_t* num_seats, size_t* xs, size_t* ys);
+
+/// Adds a SHOW request to the batch being built.
+/// @param event_id Id of the event to print.
+/// @return 0 if the request was added successfully, 1 otherwise.
+int ems_batch_show(unsigned int event_id);
+
+/// Adds a LIST request to the batch being built.
+/// @return 0 if the request was added successfully, 1 otherwise.
+int ems_batch_list_events(void);
+
+/// Gets the number of requests in the batch being built.
+/// @return Number of requests.
+size_t ems_batch_size(void);
+
+/// Sends the batch being built and waits for the results of its requests, which
+/// leaves the batch empty.
+/// @param out_fd File descriptor to print the events shown and listed to, in order.
+/// @param statuses Array of ems_batch_size() variables to store the result of each
+/// request in: 0 if it succeeded, 1 otherwise.
+/// @return 0 if every result was received, 1 otherwise, in which case the requests
+/// whose results are missing are reported as failed.
+int ems_batch_run(int out_fd, int* statuses);
+
 #endif  // CLIENT_API_H
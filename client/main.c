@@ -1,5 +1,6 @@
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -7,12 +8,70 @@
 #include "common/constants.h"
 #include "parser.h"
 
+static enum Command batch[MAX_BATCH_SIZE];  // Commands in the batch being built, in order
+
+/// Reports the failure of a command.
+/// @param cmd Command that was sent.
+/// @param result Result of the command.
+static void report_result(enum Command cmd, int result) {
+  if (result == 0) return;
+
+  if (cmd == CMD_CREATE) {
+    fprintf(stderr, "Failed to create event\n");
+  } else if (cmd == CMD_RESERVE || cmd == CMD_RESERVE_ALL) {
+    fprintf(stderr, "Failed to reserve seats\n");
+  } else if (cmd == CMD_SHOW) {
+    fprintf(stderr, "Failed to show event\n");
+  } else {
+    fprintf(stderr, "Failed to list events\n");
+  }
+}
+
+/// Sends the commands batched so far, printing the events they show and list.
+/// @param out_fd File descriptor of the output file.
+static void run_batch(int out_fd) {
+  size_t count = ems_batch_size();
+  if (count == 0) return;
+
+  int results[MAX_BATCH_SIZE];
+  if (ems_batch_run(out_fd, results) != 0) fprintf(stderr, "Failed to run batch\n");
+  for (size_t i = 0; i < count; i++) {
+    report_result(batch[i], results[i]);
+  }
+}
+
+/// Records a command added to the batch.
+/// @param cmd Command added.
+/// @param ret Result of adding it, whose failure is reported right away.
+static void track(enum Command cmd, int ret) {
+  if (ret != 0) {
+    report_result(cmd, 1);
+    return;
+  }
+  batch[ems_batch_size() - 1] = cmd;
+}
+
 int main(int argc, char* argv[]) {
-  if (argc < 5) {
-    fprintf(stderr, "Usage: %s <request pipe path> <response pipe path> <server pipe path> <.jobs file path>\n", argv[0]);
+  if (argc < 5 || argc > 6) {
+    fprintf(stderr,
+            "Usage: %s <request pipe path> <response pipe path> <server pipe path> <.jobs file path> "
+            "[batch size]\n",
+            argv[0]);
     return 1;
   }
 
+  // Number of commands that may be sent together in one batch
+  size_t batch_size = MAX_BATCH_SIZE;
+  if (argc == 6) {
+    char* endptr;
+    unsigned long value = strtoul(argv[5], &endptr, 10);
+    if (*endptr != '\0' || value == 0 || value > MAX_BATCH_SIZE) {
+      fprintf(stderr, "Invalid batch size, it must be between 1 and %d\n", MAX_BATCH_SIZE);
+      return 1;
+    }
+    batch_size = (size_t)value;
+  }
+
   if (ems_setup(argv[1], argv[2], argv[3]) != 0) {
     fprintf(stderr, "Failed to set up EMS\n");
     return 1;
@@ -35,59 +94,94 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  // The commands are parsed from memory, so the file is no longer needed once loaded
+  struct JobReader jobs;
+  int loaded = job_reader_open(&jobs, in_fd);
+  close(in_fd);
+  if (loaded != 0) {
+    fprintf(stderr, "Failed to read input file. Path: %s\n", argv[4]);
+    return 1;
+  }
+
   int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0664);
   if (out_fd == -1) {
     fprintf(stderr, "Failed to open output file. Path: %s\n", out_path);
-    close(in_fd);
+    job_reader_close(&jobs);
     return 1;
   }
 
+  // Commands are batched until the output of a SHOW or LIST is due, a WAIT or
+  // STATS needs the earlier ones done, or the batch is full
   while (1) {
+    if (ems_batch_size() == batch_size) run_batch(out_fd);
+
     unsigned int event_id;
-    size_t num_rows, num_columns, num_coords;
+    size_t num_rows, num_columns, num_coords, num_events;
     unsigned int delay = 0;
     size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+    unsigned int event_ids[MAX_TRANSACTION_EVENTS];
+    size_t num_seats[MAX_TRANSACTION_EVENTS];
 
-    switch (get_next(in_fd)) {
+    switch (get_next(&jobs)) {
       case CMD_CREATE:
-        if (parse_create(in_fd, &event_id, &num_rows, &num_columns) != 0) {
+        if (parse_create(&jobs, &event_id, &num_rows, &num_columns) != 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
 
-        if (ems_create(event_id, num_rows, num_columns) != 0) fprintf(stderr, "Failed to create event\n");
+        track(CMD_CREATE, ems_batch_create(event_id, num_rows, num_columns));
         break;
 
       case CMD_RESERVE:
-        num_coords = parse_reserve(in_fd, MAX_RESERVATION_SIZE, &event_id, xs, ys);
+        num_coords = parse_reserve(&jobs, MAX_RESERVATION_SIZE, &event_id, xs, ys);
 
         if (num_coords == 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
 
-        if (ems_reserve(event_id, num_coords, xs, ys) != 0) fprintf(stderr, "Failed to reserve seats\n");
+        track(CMD_RESERVE, ems_batch_reserve(event_id, num_coords, xs, ys));
+        break;
+
+      case CMD_RESERVE_ALL:
+        num_events =
+            parse_reserve_all(&jobs, MAX_TRANSACTION_EVENTS, MAX_RESERVATION_SIZE, event_ids, num_seats, xs, ys);
+
+        if (num_events == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        track(CMD_RESERVE_ALL, ems_batch_reserve_all(num_events, event_ids, num_seats, xs, ys));
         break;
 
       case CMD_SHOW:
-        if (parse_show(in_fd, &event_id) != 0) {
+        if (parse_show(&jobs, &event_id) != 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
 
-        if (ems_show(out_fd, event_id) != 0) fprintf(stderr, "Failed to show event\n");
+        track(CMD_SHOW, ems_batch_show(event_id));
+        run_batch(out_fd);
         break;
 
       case CMD_LIST_EVENTS:
-        if (ems_list_events(out_fd) != 0) fprintf(stderr, "Failed to list events\n");
+        track(CMD_LIST_EVENTS, ems_batch_list_events());
+        run_batch(out_fd);
+        break;
+
+      case CMD_STATS:
+        run_batch(out_fd);
+        if (ems_stats(out_fd) != 0) fprintf(stderr, "Failed to get statistics\n");
         break;
 
       case CMD_WAIT:
-        if (parse_wait(in_fd, &delay, NULL) == -1) {
+        if (parse_wait(&jobs, &delay, NULL) == -1) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
 
+        run_batch(out_fd);
         if (delay > 0) {
           printf("Waiting...\n");
           sleep(delay);
@@ -103,8 +197,10 @@ int main(int argc, char* argv[]) {
             "Available commands:\n"
             "  CREATE <event_id> <num_rows> <num_columns>\n"
             "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+            "  RESERVE_ALL <event_id> [(<x1>,<y1>) ...] <event_id> [(<x1>,<y1>) ...] ...\n"
             "  SHOW <event_id>\n"
             "  LIST\n"
+            "  STATS\n"
             "  WAIT <delay_ms>\n"
             "  HELP\n");
 
@@ -114,7 +210,8 @@ int main(int argc, char* argv[]) {
         break;
 
       case EOC:
-        close(in_fd);
+        run_batch(out_fd);
+        job_reader_close(&jobs);
         close(out_fd);
         
         ems_quit();
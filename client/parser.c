@@ -1,115 +1,259 @@
 #include "parser.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "common/constants.h"
-#include "common/io.h"
 
-static void cleanup(int fd) {
-  char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
-    ;
+#define READ_BLOCK_SIZE 65536
+
+int job_reader_open(struct JobReader *reader, int fd) {
+  reader->pos = 0;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+      reader->data = data;
+      reader->size = (size_t)st.st_size;
+      reader->mapped = 1;
+      return 0;
+    }
+  }
+
+  // Files that cannot be mapped, such as pipes, are read in blocks
+  size_t capacity = READ_BLOCK_SIZE;
+  size_t size = 0;
+  char *data = malloc(capacity);
+  if (data == NULL) {
+    return 1;
+  }
+
+  while (1) {
+    if (size == capacity) {
+      char *grown = realloc(data, capacity * 2);
+      if (grown == NULL) {
+        free(data);
+        return 1;
+      }
+      data = grown;
+      capacity *= 2;
+    }
+
+    ssize_t read_bytes = read(fd, data + size, capacity - size);
+    if (read_bytes == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      free(data);
+      return 1;
+    }
+    if (read_bytes == 0) {
+      break;
+    }
+    size += (size_t)read_bytes;
+  }
+
+  reader->data = data;
+  reader->size = size;
+  reader->mapped = 0;
+  return 0;
+}
+
+void job_reader_close(struct JobReader *reader) {
+  if (reader->mapped) {
+    munmap((void *)reader->data, reader->size);
+  } else {
+    free((void *)reader->data);
+  }
+  reader->data = NULL;
+}
+
+/// Takes the next character of the job file.
+/// @param reader Job file to read from.
+/// @param ch Pointer to store the character in.
+/// @return 1 if a character was taken, 0 at the end of the file.
+static int next_char(struct JobReader *reader, char *ch) {
+  if (reader->pos >= reader->size) {
+    return 0;
+  }
+  *ch = reader->data[reader->pos++];
+  return 1;
+}
+
+static void cleanup(struct JobReader *reader) {
+  const char *newline = memchr(reader->data + reader->pos, '\n', reader->size - reader->pos);
+  reader->pos = newline != NULL ? (size_t)(newline - reader->data) + 1 : reader->size;
+}
+
+/// Consumes the rest of a keyword, the same number of characters whether it matches or not.
+/// @param reader Job file to read from.
+/// @param rest Expected characters after the first one.
+/// @param len Number of expected characters.
+/// @return 1 if the characters match, 0 otherwise.
+static int match(struct JobReader *reader, const char *rest, size_t len) {
+  size_t available = reader->size - reader->pos;
+  int matches = available >= len && memcmp(reader->data + reader->pos, rest, len) == 0;
+  reader->pos += available < len ? available : len;
+  return matches;
+}
+
+/// Parses an unsigned integer, consuming the character that ends it.
+/// @param reader Job file to read from.
+/// @param value Pointer to the variable to store the value in.
+/// @param next Pointer to store the character after the digits in, '\0' at the end of the file.
+/// @return 0 if the integer was parsed successfully, 1 if it does not fit.
+static int parse_uint(struct JobReader *reader, unsigned int *value, char *next) {
+  unsigned long long result = 0;
+
+  while (1) {
+    if (!next_char(reader, next)) {
+      *next = '\0';
+      break;
+    }
+
+    char ch = *next;
+    if (ch > '9' || ch < '0') {
+      break;
+    }
+
+    result = result * 10 + (unsigned long long)(ch - '0');
+    if (result > UINT_MAX) {
+      return 1;
+    }
+  }
+
+  *value = (unsigned int)result;
+  return 0;
 }
 
-enum Command get_next(int fd) {
-  char buf[16];
-  if (read(fd, buf, 1) != 1) {
+enum Command get_next(struct JobReader *reader) {
+  char ch;
+  if (!next_char(reader, &ch)) {
     return EOC;
   }
 
-  switch (buf[0]) {
+  switch (ch) {
     case 'C':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
-        cleanup(fd);
+      if (!match(reader, "REATE ", 6)) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_CREATE;
 
     case 'R':
-      if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
-        cleanup(fd);
+      // RESERVE_ALL starts like RESERVE
+      if (!match(reader, "ESERVE", 6) || !next_char(reader, &ch) || (ch != ' ' && ch != '_')) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
+      if (ch == '_') {
+        if (!match(reader, "ALL ", 4)) {
+          cleanup(reader);
+          return CMD_INVALID;
+        }
+
+        return CMD_RESERVE_ALL;
+      }
+
       return CMD_RESERVE;
 
     case 'S':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
-        cleanup(fd);
+      // STATS and SHOW share their first letter
+      if (reader->pos < reader->size && reader->data[reader->pos] == 'T') {
+        if (!match(reader, "TATS", 4)) {
+          cleanup(reader);
+          return CMD_INVALID;
+        }
+
+        if (next_char(reader, &ch) && ch != '\n') {
+          cleanup(reader);
+          return CMD_INVALID;
+        }
+
+        return CMD_STATS;
+      }
+
+      if (!match(reader, "HOW ", 4)) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_SHOW;
 
     case 'L':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
-        cleanup(fd);
+      if (!match(reader, "IST", 3)) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-        cleanup(fd);
+      if (next_char(reader, &ch) && ch != '\n') {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_LIST_EVENTS;
 
     case 'W':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
-        cleanup(fd);
+      if (!match(reader, "AIT ", 4)) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_WAIT;
 
     case 'H':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
-        cleanup(fd);
+      if (!match(reader, "ELP", 3)) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-        cleanup(fd);
+      if (next_char(reader, &ch) && ch != '\n') {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_HELP;
 
     case '#':
-      cleanup(fd);
+      cleanup(reader);
       return CMD_EMPTY;
 
     case '\n':
       return CMD_EMPTY;
 
     default:
-      cleanup(fd);
+      cleanup(reader);
       return CMD_INVALID;
   }
 }
 
-int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_cols) {
+int parse_create(struct JobReader *reader, unsigned int *event_id, size_t *num_rows, size_t *num_cols) {
   char ch;
 
-  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (parse_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 1;
   }
 
   unsigned int u_num_rows;
-  if (parse_uint(fd, &u_num_rows, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (parse_uint(reader, &u_num_rows, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 1;
   }
   *num_rows = (size_t)u_num_rows;
 
   unsigned int u_num_cols;
-  if (parse_uint(fd, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (parse_uint(reader, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 1;
   }
   *num_cols = (size_t)u_num_cols;
@@ -117,44 +261,45 @@ int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_c
   return 0;
 }
 
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
+/// Parses the seats of a reservation, from the opening bracket to the closing one.
+/// @param reader Job file to read from.
+/// @param max Maximum number of coordinates to read.
+/// @param xs Pointer to the array to store the X coordinates in.
+/// @param ys Pointer to the array to store the Y coordinates in.
+/// @return Number of coordinates read. 0 on failure, after skipping the rest of the line.
+static size_t parse_seats(struct JobReader *reader, size_t max, size_t *xs, size_t *ys) {
   char ch;
 
-  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
-    return 0;
-  }
-
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
+  if (!next_char(reader, &ch) || ch != '[') {
+    cleanup(reader);
     return 0;
   }
 
   size_t num_coords = 0;
   while (num_coords < max) {
-    if (read(fd, &ch, 1) != 1 || ch != '(') {
-      cleanup(fd);
+    if (!next_char(reader, &ch) || ch != '(') {
+      cleanup(reader);
       return 0;
     }
 
     unsigned int x;
-    if (parse_uint(fd, &x, &ch) != 0 || ch != ',') {
-      cleanup(fd);
+    if (parse_uint(reader, &x, &ch) != 0 || ch != ',') {
+      cleanup(reader);
       return 0;
     }
     xs[num_coords] = (size_t)x;
 
     unsigned int y;
-    if (parse_uint(fd, &y, &ch) != 0 || ch != ')') {
-      cleanup(fd);
+    if (parse_uint(reader, &y, &ch) != 0 || ch != ')') {
+      cleanup(reader);
       return 0;
     }
     ys[num_coords] = (size_t)y;
 
     num_coords++;
 
-    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
-      cleanup(fd);
+    if (!next_char(reader, &ch) || (ch != ' ' && ch != ']')) {
+      cleanup(reader);
       return 0;
     }
 
@@ -164,45 +309,94 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
   }
 
   if (num_coords == max) {
-    cleanup(fd);
+    cleanup(reader);
+    return 0;
+  }
+
+  return num_coords;
+}
+
+size_t parse_reserve(struct JobReader *reader, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
+  char ch;
+
+  if (parse_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  size_t num_coords = parse_seats(reader, max, xs, ys);
+  if (num_coords == 0) {
+    return 0;
+  }
+
+  if (!next_char(reader, &ch) || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 0;
   }
 
   return num_coords;
 }
 
-int parse_show(int fd, unsigned int *event_id) {
+size_t parse_reserve_all(struct JobReader *reader, size_t max_events, size_t max_seats, unsigned int *event_ids,
+                         size_t *num_seats, size_t *xs, size_t *ys) {
+  size_t num_events = 0;
+  size_t total = 0;
+  char ch = ' ';
+
+  while (ch == ' ') {
+    if (num_events == max_events) {
+      cleanup(reader);
+      return 0;
+    }
+
+    if (parse_uint(reader, &event_ids[num_events], &ch) != 0 || ch != ' ') {
+      cleanup(reader);
+      return 0;
+    }
+
+    size_t num_coords = parse_seats(reader, max_seats - total, xs + total, ys + total);
+    if (num_coords == 0) {
+      return 0;
+    }
+    num_seats[num_events++] = num_coords;
+    total += num_coords;
+
+    if (!next_char(reader, &ch) || (ch != ' ' && ch != '\n' && ch != '\0')) {
+      cleanup(reader);
+      return 0;
+    }
+  }
+
+  return num_events;
+}
+
+int parse_show(struct JobReader *reader, unsigned int *event_id) {
   char ch;
 
-  if (parse_uint(fd, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (parse_uint(reader, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 1;
   }
 
   return 0;
 }
 
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
+int parse_wait(struct JobReader *reader, unsigned int *delay, unsigned int *thread_id) {
   char ch;
 
-  if (parse_uint(fd, delay, &ch) != 0) {
-    cleanup(fd);
+  if (parse_uint(reader, delay, &ch) != 0) {
+    cleanup(reader);
     return -1;
   }
 
   if (ch == ' ') {
     if (thread_id == NULL) {
-      cleanup(fd);
+      cleanup(reader);
       return 0;
     }
 
-    if (parse_uint(fd, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-      cleanup(fd);
+    if (parse_uint(reader, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+      cleanup(reader);
       return -1;
     }
 
@@ -210,7 +404,7 @@ int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
   } else if (ch == '\n' || ch == '\0') {
     return 0;
   } else {
-    cleanup(fd);
+    cleanup(reader);
     return -1;
   }
 }
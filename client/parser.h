@@ -3,11 +3,21 @@
 
 #include <stddef.h>
 
+// Job file loaded in memory, either mapped or read in blocks
+struct JobReader {
+  const char *data;  // Contents of the file
+  size_t size;       // Size of the contents
+  size_t pos;        // Position of the next character to parse
+  int mapped;        // Whether data is a mapping rather than an allocated copy
+};
+
 enum Command {
   CMD_CREATE,
   CMD_RESERVE,
+  CMD_RESERVE_ALL,
   CMD_SHOW,
   CMD_LIST_EVENTS,
+  CMD_STATS,
   CMD_WAIT,
   CMD_HELP,
   CMD_EMPTY,
@@ -15,39 +25,63 @@ enum Command {
   EOC  // End of commands
 };
 
+/// Loads a job file to be parsed from memory.
+/// @note Regular files are mapped; anything else is read in blocks.
+/// @param reader Reader to be initialized.
+/// @param fd File descriptor of the job file.
+/// @return 0 if the file was loaded successfully, 1 otherwise.
+int job_reader_open(struct JobReader *reader, int fd);
+
+/// Releases the contents of a job file.
+/// @param reader Reader to be released.
+void job_reader_close(struct JobReader *reader);
+
 /// Reads a line and returns the corresponding command.
-/// @param fd File descriptor to read from.
+/// @param reader Job file to read from.
 /// @return The command read.
-enum Command get_next(int fd);
+enum Command get_next(struct JobReader *reader);
 
 /// Parses a CREATE command.
-/// @param fd File descriptor to read from.
+/// @param reader Job file to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @param num_rows Pointer to the variable to store the number of rows in.
 /// @param num_cols Pointer to the variable to store the number of columns in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
-int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_cols);
+int parse_create(struct JobReader *reader, unsigned int *event_id, size_t *num_rows, size_t *num_cols);
 
 /// Parses a RESERVE command.
-/// @param fd File descriptor to read from.
+/// @param reader Job file to read from.
 /// @param max Maximum number of coordinates to read.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @param xs Pointer to the array to store the X coordinates in.
 /// @param ys Pointer to the array to store the Y coordinates in.
 /// @return Number of coordinates read. 0 on failure.
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys);
+size_t parse_reserve(struct JobReader *reader, size_t max, unsigned int *event_id, size_t *xs, size_t *ys);
+
+/// Parses a RESERVE_ALL command, which holds the event ID and seats of a RESERVE for
+/// each event.
+/// @param reader Job file to read from.
+/// @param max_events Maximum number of events to read.
+/// @param max_seats Maximum number of coordinates to read, in all the events.
+/// @param event_ids Pointer to the array to store the event IDs in.
+/// @param num_seats Pointer to the array to store the number of coordinates of each event in.
+/// @param xs Pointer to the array to store the X coordinates in, those of each event after the previous ones.
+/// @param ys Pointer to the array to store the Y coordinates in, in the same order.
+/// @return Number of events read. 0 on failure.
+size_t parse_reserve_all(struct JobReader *reader, size_t max_events, size_t max_seats, unsigned int *event_ids,
+                         size_t *num_seats, size_t *xs, size_t *ys);
 
 /// Parses a SHOW command.
-/// @param fd File descriptor to read from.
+/// @param reader Job file to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
-int parse_show(int fd, unsigned int *event_id);
+int parse_show(struct JobReader *reader, unsigned int *event_id);
 
 /// Parses a WAIT command.
-/// @param fd File descriptor to read from.
+/// @param reader Job file to read from.
 /// @param delay Pointer to the variable to store the wait delay in.
 /// @param thread_id Pointer to the variable to store the thread ID in. May not be set.
 /// @return 0 if no thread was specified, 1 if a thread was specified, -1 on error.
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id);
+int parse_wait(struct JobReader *reader, unsigned int *delay, unsigned int *thread_id);
 
 #endif  // CLIENT_PARSER_H
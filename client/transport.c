@@ -0,0 +1,214 @@
+#include "transport.h"
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "common/io.h"
+#include "common/ring.h"
+
+// Shared-memory connections made by this process, numbering their segments
+static atomic_uint shm_connections;
+
+/// Sends a registration message through the server FIFO.
+/// @param server_pipe_path Path to the server FIFO.
+/// @param setup_code Code of the registration.
+/// @param first First name carried by the message.
+/// @param second Second name carried by the message.
+/// @return 0 if the message was sent successfully, 1 otherwise.
+static int send_registration(char const* server_pipe_path, char setup_code, char const* first, char const* second) {
+  // Open server pipe for writing. It waits until the server opens it for reading
+  int server_pipe_fd = open(server_pipe_path, O_WRONLY);
+  if (server_pipe_fd == -1) {
+    fprintf(stderr, "Failed to open pipe\n");
+    return 1;
+  }
+
+  // Create register message
+  char register_msg[1 + 2 * PIPE_NAME_SIZE];
+  memset(register_msg, '\0', sizeof(register_msg));
+  register_msg[0] = setup_code;
+  strncpy(register_msg + 1, first, strlen(first));
+  strncpy(register_msg + 1 + PIPE_NAME_SIZE, second, strlen(second));
+
+  // Write to server pipe
+  if (write_str(server_pipe_fd, register_msg, sizeof(register_msg)) != 0){
+    fprintf(stderr, "Failed to write to pipe\n");
+    close(server_pipe_fd);
+    return 1;
+  }
+
+  if(close(server_pipe_fd) != 0){
+    fprintf(stderr, "Failed to close pipe\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+static int fifo_connect(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path,
+                        struct Connection* conn) {
+  conn->shm = NULL;
+
+  // Unlink pipes
+  unlink(req_pipe_path);
+  unlink(resp_pipe_path);
+
+  // Create pipes
+  if (mkfifo(req_pipe_path, 0664) != 0) {
+    fprintf(stderr, "Failed to create pipe\n");
+    return 1;
+  }
+  if (mkfifo(resp_pipe_path, 0664) != 0) {
+    fprintf(stderr, "Failed to create pipe\n");
+    unlink(req_pipe_path);
+    return 1;
+  }
+
+  if (send_registration(server_pipe_path, '1', req_pipe_path, resp_pipe_path) != 0) {
+    unlink(req_pipe_path);
+    unlink(resp_pipe_path);
+    return 1;
+  }
+
+  // Open client pipes
+  conn->resp_fd = open(resp_pipe_path, O_RDONLY);
+  if (conn->resp_fd == -1) {
+    fprintf(stderr, "Failed to open pipe\n");
+    unlink(req_pipe_path);
+    unlink(resp_pipe_path);
+    return 1;
+  }
+  conn->req_fd = open(req_pipe_path, O_WRONLY);
+  if (conn->req_fd == -1) {
+    fprintf(stderr, "Failed to open pipe\n");
+    close(conn->resp_fd);
+    unlink(req_pipe_path);
+    unlink(resp_pipe_path);
+    return 1;
+  }
+
+  return 0;
+}
+
+static int socket_connect(char const* req_pipe_path, char const* resp_pipe_path, char const* socket_path,
+                          struct Connection* conn) {
+  (void)req_pipe_path;
+  (void)resp_pipe_path;
+  conn->shm = NULL;
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long\n");
+    return 1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  conn->req_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (conn->req_fd == -1) {
+    fprintf(stderr, "Failed to create socket\n");
+    return 1;
+  }
+
+  if (connect(conn->req_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "Failed to connect to socket\n");
+    close(conn->req_fd);
+    return 1;
+  }
+
+  // Give each direction its own descriptor, as with the pipes
+  conn->resp_fd = dup(conn->req_fd);
+  if (conn->resp_fd == -1) {
+    fprintf(stderr, "Failed to duplicate socket\n");
+    close(conn->req_fd);
+    return 1;
+  }
+
+  return 0;
+}
+
+static int close_pair(struct Connection* conn) {
+  if(close(conn->resp_fd) != 0){
+    fprintf(stderr, "Failed to close pipe\n");
+    close(conn->req_fd);
+    return 1;
+  }
+
+  if(close(conn->req_fd) != 0){
+    fprintf(stderr, "Failed to close pipe\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+static int shm_connect(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path,
+                       struct Connection* conn) {
+  (void)req_pipe_path;
+  (void)resp_pipe_path;
+
+  // Each connection gets a segment of its own, even within one process
+  char name[PIPE_NAME_SIZE];
+  snprintf(name, sizeof(name), "/ems-%d-%u", (int)getpid(), atomic_fetch_add(&shm_connections, 1));
+
+  conn->shm = shm_segment_create(name, &conn->req_fd);
+  if (conn->shm == NULL) {
+    fprintf(stderr, "Failed to create shared memory\n");
+    return 1;
+  }
+
+  // The segment descriptor stands in for both rings
+  conn->resp_fd = dup(conn->req_fd);
+  if (conn->resp_fd == -1) {
+    fprintf(stderr, "Failed to attach shared memory\n");
+    shm_segment_close(conn->shm);
+    shm_unlink(name);
+    close(conn->req_fd);
+    return 1;
+  }
+
+  // The server removes the name once it maps the segment
+  if (send_registration(server_pipe_path, '7', name, "") != 0) {
+    shm_segment_close(conn->shm);
+    shm_unlink(name);
+    close(conn->req_fd);
+    close(conn->resp_fd);
+    return 1;
+  }
+
+  return 0;
+}
+
+static int shm_disconnect(struct Connection* conn) {
+  shm_segment_close(conn->shm);
+  conn->shm = NULL;
+
+  return close_pair(conn);
+}
+
+const struct Transport fifo_transport = {fifo_connect, close_pair};
+
+const struct Transport socket_transport = {socket_connect, close_pair};
+
+const struct Transport shm_transport = {shm_connect, shm_disconnect};
+
+const struct Transport* select_transport(char const* server_path) {
+  char const* requested = getenv("EMS_TRANSPORT");
+  if (requested != NULL && strcmp(requested, "shm") == 0) {
+    return &shm_transport;
+  }
+
+  struct stat st;
+  if (stat(server_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    return &socket_transport;
+  }
+  return &fifo_transport;
+}
@@ -0,0 +1,47 @@
+#ifndef CLIENT_TRANSPORT_H
+#define CLIENT_TRANSPORT_H
+
+struct ShmSegment;
+
+// Connection to an EMS server, as set up by a transport
+struct Connection {
+  int req_fd;              // Descriptor requests are sent to
+  int resp_fd;             // Descriptor responses are received from
+  struct ShmSegment* shm;  // Segment whose rings stand in for both descriptors, NULL if not shared memory
+};
+
+// Way of reaching an EMS server. Every transport yields a pair of descriptors
+// carrying the same request/response protocol, so the API is unaware of it.
+struct Transport {
+  /// Connects to an EMS server, ready to read the session id from the response descriptor.
+  /// @param req_pipe_path Path to the request pipe, if the transport uses one.
+  /// @param resp_pipe_path Path to the response pipe, if the transport uses one.
+  /// @param server_path Path where the server is listening.
+  /// @param conn Connection to be set up.
+  /// @return 0 if the connection was established successfully, 1 otherwise.
+  int (*connect)(char const* req_pipe_path, char const* resp_pipe_path, char const* server_path,
+                 struct Connection* conn);
+
+  /// Closes a connection.
+  /// @param conn Connection to be closed.
+  /// @return 0 if the connection was closed successfully, 1 otherwise.
+  int (*disconnect)(struct Connection* conn);
+};
+
+/// Named pipes registered through the server FIFO.
+extern const struct Transport fifo_transport;
+
+/// Unix domain stream socket.
+extern const struct Transport socket_transport;
+
+/// Shared-memory rings registered through the server FIFO.
+extern const struct Transport shm_transport;
+
+/// Picks the transport for the given server path: the shared-memory transport if
+/// EMS_TRANSPORT=shm is set, the socket transport if the path is a socket and the
+/// FIFO transport otherwise.
+/// @param server_path Path where the server is listening.
+/// @return The transport to use.
+const struct Transport* select_transport(char const* server_path);
+
+#endif  // CLIENT_TRANSPORT_H
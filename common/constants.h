@@ -3,4 +3,12 @@
 #define MAX_JOB_FILE_NAME_SIZE 256
 #define MAX_SESSION_COUNT 4
 #define PIPE_NAME_SIZE 40
-
+#define POOL_IDLE_TIMEOUT_MS 5000
+#define STATS_DUMP_INTERVAL_S 10
+#define MAX_BATCH_SIZE 1024
+#define TRACE_FLUSH_INTERVAL_MS 1000
+#define MAX_TRANSACTION_EVENTS 16
+#define ACCEPT_RETRY_DELAY_MS 100
+// Largest body of a framed request: a batch of MAX_BATCH_SIZE reservations
+// across MAX_TRANSACTION_EVENTS events, every coordinate a 10-byte varint
+#define MAX_REQUEST_BODY_SIZE (MAX_BATCH_SIZE * (2 + MAX_TRANSACTION_EVENTS * 7 + MAX_RESERVATION_SIZE * 20))
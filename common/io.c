@@ -1,11 +1,76 @@
 #include "io.h"
 
+#include <errno.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <stdio.h>
 
+#include "ring.h"
+
+/// Reads from a descriptor or from the ring standing in for it.
+static ssize_t io_read(int fd, struct Ring *ring, void *buf, size_t len) {
+  return ring != NULL ? ring_read(ring, buf, len) : read(fd, buf, len);
+}
+
+/// Writes to a descriptor or to the ring standing in for it.
+static ssize_t io_write(int fd, struct Ring *ring, const void *buf, size_t len) {
+  return ring != NULL ? ring_write(ring, buf, len) : write(fd, buf, len);
+}
+
+/// Gathers buffers into a descriptor or into the ring standing in for it.
+static ssize_t io_writev(int fd, struct Ring *ring, const struct iovec *iov, int iovcnt) {
+  if (ring == NULL) {
+    return writev(fd, iov, iovcnt);
+  }
+
+  // Fill the ring with as many of the buffers as fit
+  ssize_t total = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len == 0) {
+      continue;
+    }
+    ssize_t ret = ring_write(ring, iov[i].iov_base, iov[i].iov_len);
+    if (ret == -1) {
+      return total > 0 ? total : -1;
+    }
+    total += ret;
+    if ((size_t)ret < iov[i].iov_len) {
+      break;
+    }
+  }
+  return total;
+}
+
+/// Waits until the given file descriptor has data to read.
+/// @param fd The file descriptor to wait on.
+/// @return 0 if there is data to read, 1 otherwise.
+static int wait_readable(int fd) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (poll(&pfd, 1, -1) == -1) {
+    if (errno != EINTR) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Waits until the given file descriptor has room to write.
+/// @param fd The file descriptor to wait on.
+/// @return 0 if there is room to write, 1 otherwise.
+static int wait_writable(int fd) {
+  struct pollfd pfd = {fd, POLLOUT, 0};
+  while (poll(&pfd, 1, -1) == -1) {
+    if (errno != EINTR) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 int parse_uint(int fd, unsigned int *value, char *next) {
   char buf[16];
 
@@ -40,28 +105,37 @@ int parse_uint(int fd, unsigned int *value, char *next) {
   return 0;
 }
 
-int print_uint(int fd, unsigned int value) {
-  char buffer[16];
-  size_t i = 16;
-
-  for (; value > 0; value /= 10) {
-    buffer[--i] = '0' + (char)(value % 10);
+size_t format_uint(char *buf, unsigned int value) {
+  static const char digit_pairs[] =
+      "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+      "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+      "8081828384858687888990919293949596979899";
+  char tmp[10];
+  size_t i = 10;
+
+  // Emit two digits per division
+  while (value >= 100) {
+    unsigned int pair = (value % 100) * 2;
+    value /= 100;
+    tmp[--i] = digit_pairs[pair + 1];
+    tmp[--i] = digit_pairs[pair];
   }
-
-  if (i == 16) {
-    buffer[--i] = '0';
+  if (value >= 10) {
+    tmp[--i] = digit_pairs[value * 2 + 1];
+    tmp[--i] = digit_pairs[value * 2];
+  } else {
+    tmp[--i] = '0' + (char)value;
   }
 
-  while (i < 16) {
-    ssize_t written = write(fd, buffer + i, 16 - i);
-    if (written == -1) {
-      return 1;
-    }
+  memcpy(buf, tmp + i, 10 - i);
+  return 10 - i;
+}
 
-    i += (size_t)written;
-  }
+int print_uint(int fd, unsigned int value) {
+  char buffer[16];
+  size_t len = format_uint(buffer, value);
 
-  return 0;
+  return write_str(fd, buffer, len);
 }
 
 int print_str(int fd, const char *str) {
@@ -79,12 +153,21 @@ int print_str(int fd, const char *str) {
   return 0;
 }
 
-int write_str(int fd, char *str, size_t len) {
+/// Writes a buffer to a descriptor or to the ring standing in for it.
+/// @return 0 if the buffer was written successfully, 1 otherwise.
+static int send_all(int fd, struct Ring *ring, const char *str, size_t len) {
   size_t done = 0;
 
   while (done < len) {
-    ssize_t ret = write(fd, str + done, len - done);
+    ssize_t ret = io_write(fd, ring, str + done, len - done);
     if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // A descriptor shared with a non-blocking reader is non-blocking too
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(fd) == 0) {
+        continue;
+      }
       return 1;
     }
 
@@ -93,11 +176,13 @@ int write_str(int fd, char *str, size_t len) {
   return 0;
 }
 
+int write_str(int fd, char *str, size_t len) { return send_all(fd, NULL, str, len); }
+
 int write_int(int fd, int *i) {
   size_t done = 0;
 
   while(done < sizeof(int)) {
-    ssize_t ret = write(fd, i + done, sizeof(int) - done);
+    ssize_t ret = write(fd, (char *)i + done, sizeof(int) - done);
     if(ret == -1) {
       return 1;
     }
@@ -111,7 +196,7 @@ int write_uint(int fd, unsigned int *i) {
   size_t done = 0;
 
   while(done < sizeof(unsigned int)) {
-    ssize_t ret = write(fd, i + done, sizeof(unsigned int) - done);
+    ssize_t ret = write(fd, (char *)i + done, sizeof(unsigned int) - done);
     if(ret == -1) {
       return 1;
     }
@@ -125,7 +210,7 @@ int write_sizet(int fd, size_t *i) {
   size_t done = 0;
 
   while(done < sizeof(size_t)) {
-    ssize_t ret = write(fd, i + done, sizeof(size_t) - done);
+    ssize_t ret = write(fd, (char *)i + done, sizeof(size_t) - done);
     
     if(ret == -1) {
       return 1;
@@ -136,11 +221,44 @@ int write_sizet(int fd, size_t *i) {
   return 0;
 }
 
+/// Writes a set of buffers to a descriptor or to the ring standing in for it.
+/// @return 0 if the buffers were written successfully, 1 otherwise.
+static int send_iov(int fd, struct Ring *ring, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t ret = io_writev(fd, ring, iov, iovcnt);
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // A descriptor shared with a non-blocking reader is non-blocking too
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(fd) == 0) {
+        continue;
+      }
+      return 1;
+    }
+
+    size_t done = (size_t)ret;
+    while (iovcnt > 0 && done >= iov->iov_len) {
+      done -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + done;
+      iov->iov_len -= done;
+    }
+  }
+  return 0;
+}
+
 int read_str(int fd, char *str, size_t len) {
   size_t done = 0;
   while(done < len) {
     ssize_t ret = read(fd, str + done, len - done);
     if(ret == -1) {
+      if((errno == EAGAIN || errno == EWOULDBLOCK) && wait_readable(fd) == 0) {
+        continue;
+      }
       return 1;
     }
     if(ret == 0) {
@@ -155,8 +273,11 @@ int read_str(int fd, char *str, size_t len) {
 int read_int(int fd, int *i) {
   size_t done = 0;
   while(done < sizeof(int)) {
-    ssize_t ret = read(fd, i + done, sizeof(int) - done);
+    ssize_t ret = read(fd, (char *)i + done, sizeof(int) - done);
     if(ret == -1) {
+      if((errno == EAGAIN || errno == EWOULDBLOCK) && wait_readable(fd) == 0) {
+        continue;
+      }
       return 1;
     }
     if(ret == 0) {
@@ -171,8 +292,11 @@ int read_int(int fd, int *i) {
 int read_uint(int fd, unsigned int *i) {
   size_t done = 0;
   while(done < sizeof(unsigned int)) {
-    ssize_t ret = read(fd, i + done, sizeof(unsigned int) - done);
+    ssize_t ret = read(fd, (char *)i + done, sizeof(unsigned int) - done);
     if(ret == -1) {
+      if((errno == EAGAIN || errno == EWOULDBLOCK) && wait_readable(fd) == 0) {
+        continue;
+      }
       return 1;
     }
     if(ret == 0) {
@@ -187,9 +311,12 @@ int read_uint(int fd, unsigned int *i) {
 int read_sizet(int fd, size_t *i) {
   size_t done = 0;
   while(done < sizeof(size_t)) {
-    ssize_t ret = read(fd, i + done, sizeof(size_t) - done);
+    ssize_t ret = read(fd, (char *)i + done, sizeof(size_t) - done);
 
     if(ret == -1) {
+      if((errno == EAGAIN || errno == EWOULDBLOCK) && wait_readable(fd) == 0) {
+        continue;
+      }
       return 1;
     }
     if(ret == 0) {
@@ -198,4 +325,413 @@ int read_sizet(int fd, size_t *i) {
     done += (size_t)ret;
   }
   return 0;
-}
\ No newline at end of file
+}
+
+int frame_init(struct Frame *frame) {
+  frame->capacity = 256;
+  frame->data = malloc(FRAME_HEADER_SIZE + frame->capacity);
+  if (frame->data == NULL) {
+    return 1;
+  }
+  frame_reset(frame, '\0', 0);
+  return 0;
+}
+
+void frame_free(struct Frame *frame) {
+  free(frame->data);
+  frame->data = NULL;
+}
+
+void frame_reset(struct Frame *frame, char op_code, unsigned char flags) {
+  frame->op_code = op_code;
+  frame->flags = flags;
+  frame->len = 0;
+  frame->pos = 0;
+}
+
+/// Makes room for more bytes in the body of a frame.
+/// @param frame Frame to be modified.
+/// @param needed Number of bytes the body must hold.
+/// @return 0 if there is enough room, 1 otherwise.
+static int frame_reserve(struct Frame *frame, size_t needed) {
+  if (needed <= frame->capacity) {
+    return 0;
+  }
+  if (needed > FRAME_MAX_BODY_SIZE) {
+    return 1;
+  }
+
+  size_t capacity = frame->capacity * 2;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+
+  unsigned char *data = realloc(frame->data, FRAME_HEADER_SIZE + capacity);
+  if (data == NULL) {
+    return 1;
+  }
+  frame->data = data;
+  frame->capacity = capacity;
+  return 0;
+}
+
+int frame_put_varint(struct Frame *frame, uint64_t value) {
+  if (frame_reserve(frame, frame->len + 10) != 0) {
+    return 1;
+  }
+
+  unsigned char *body = frame->data + FRAME_HEADER_SIZE;
+  while (value >= 0x80) {
+    body[frame->len++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  body[frame->len++] = (unsigned char)value;
+  return 0;
+}
+
+int frame_put_svarint(struct Frame *frame, int64_t value) {
+  // Zigzag maps small negative values to small unsigned ones
+  return frame_put_varint(frame, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+int frame_put_bytes(struct Frame *frame, const void *data, size_t len) {
+  if (frame_put_varint(frame, len) != 0 || frame_reserve(frame, frame->len + len) != 0) {
+    return 1;
+  }
+
+  memcpy(frame->data + FRAME_HEADER_SIZE + frame->len, data, len);
+  frame->len += len;
+  return 0;
+}
+
+int frame_get_varint(struct Frame *frame, uint64_t *value) {
+  const unsigned char *body = frame->data + FRAME_HEADER_SIZE;
+  uint64_t result = 0;
+
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    if (frame->pos >= frame->len) {
+      return 1;
+    }
+    unsigned char byte = body[frame->pos++];
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int frame_get_svarint(struct Frame *frame, int64_t *value) {
+  uint64_t zigzag;
+  if (frame_get_varint(frame, &zigzag) != 0) {
+    return 1;
+  }
+  *value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+  return 0;
+}
+
+int frame_get_bytes(struct Frame *frame, const void **data, size_t *len) {
+  uint64_t size;
+  if (frame_get_varint(frame, &size) != 0 || size > frame->len - frame->pos) {
+    return 1;
+  }
+
+  *data = frame->data + FRAME_HEADER_SIZE + frame->pos;
+  *len = (size_t)size;
+  frame->pos += (size_t)size;
+  return 0;
+}
+
+/// Fills the header in front of the body of a frame.
+/// @param frame Frame to be sent.
+/// @return Number of bytes of the frame, header included.
+static size_t frame_seal(struct Frame *frame) {
+  uint32_t len = (uint32_t)frame->len;
+  frame->data[0] = (unsigned char)frame->op_code;
+  frame->data[1] = frame->flags;
+  memcpy(frame->data + 2, &len, sizeof(uint32_t));
+  return FRAME_HEADER_SIZE + frame->len;
+}
+
+int write_frame(int fd, struct Frame *frame) {
+  size_t len = frame_seal(frame);
+  return write_str(fd, (char *)frame->data, len);
+}
+
+/// Reads exactly len bytes, waiting on non-blocking descriptors.
+/// @return 0 if the bytes were read, 1 on failure or end of file.
+static int read_exact(int fd, unsigned char *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t ret = read(fd, buf + done, len - done);
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_readable(fd) == 0) {
+        continue;
+      }
+      return 1;
+    }
+    if (ret == 0) {
+      return 1;
+    }
+    done += (size_t)ret;
+  }
+  return 0;
+}
+
+enum ReadStatus read_frame(int fd, struct Frame *frame) {
+  unsigned char header[FRAME_HEADER_SIZE];
+
+  // Only the first byte may find the descriptor empty or closed
+  ssize_t ret;
+  do {
+    ret = read(fd, header, sizeof(header));
+  } while (ret == -1 && errno == EINTR);
+  if (ret == -1) {
+    return errno == EAGAIN || errno == EWOULDBLOCK ? READ_AGAIN : READ_ERROR;
+  }
+  if (ret == 0) {
+    return READ_EOF;
+  }
+  if (read_exact(fd, header + ret, sizeof(header) - (size_t)ret) != 0) {
+    return READ_ERROR;
+  }
+
+  uint32_t len;
+  memcpy(&len, header + 2, sizeof(uint32_t));
+  frame_reset(frame, (char)header[0], header[1]);
+  if (frame_reserve(frame, len) != 0 || read_exact(fd, frame->data + FRAME_HEADER_SIZE, len) != 0) {
+    return READ_ERROR;
+  }
+  frame->len = len;
+  return READ_OK;
+}
+
+int recv_buffer_init(struct RecvBuffer *buffer) {
+  buffer->data = malloc(RECV_BUFFER_SIZE);
+  if (buffer->data == NULL) {
+    return 1;
+  }
+  buffer->start = 0;
+  buffer->end = 0;
+  buffer->capacity = RECV_BUFFER_SIZE;
+  return 0;
+}
+
+void recv_buffer_free(struct RecvBuffer *buffer) {
+  free(buffer->data);
+  buffer->data = NULL;
+}
+
+size_t recv_buffered(const struct RecvBuffer *buffer) { return buffer->end - buffer->start; }
+
+enum ReadStatus recv_fill(int fd, struct Ring *ring, struct RecvBuffer *buffer, size_t needed, int wait) {
+  if (recv_buffered(buffer) >= needed) {
+    return READ_OK;
+  }
+  if (buffer->start == buffer->end) {
+    buffer->start = 0;
+    buffer->end = 0;
+  }
+
+  // Move the bytes left to the front, growing the buffer for messages larger than it
+  if (buffer->start + needed > buffer->capacity) {
+    size_t buffered = recv_buffered(buffer);
+    memmove(buffer->data, buffer->data + buffer->start, buffered);
+    buffer->start = 0;
+    buffer->end = buffered;
+
+    if (needed > buffer->capacity) {
+      size_t capacity = buffer->capacity * 2;
+      while (capacity < needed) {
+        capacity *= 2;
+      }
+      char *data = realloc(buffer->data, capacity);
+      if (data == NULL) {
+        return READ_ERROR;
+      }
+      buffer->data = data;
+      buffer->capacity = capacity;
+    }
+  }
+
+  while (recv_buffered(buffer) < needed) {
+    ssize_t ret = io_read(fd, ring, buffer->data + buffer->end, buffer->capacity - buffer->end);
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // The bytes read so far stay buffered for the next attempt
+        if (!wait) {
+          return READ_AGAIN;
+        }
+        if (wait_readable(fd) == 0) {
+          continue;
+        }
+      }
+      return READ_ERROR;
+    }
+    if (ret == 0) {
+      return recv_buffered(buffer) == 0 ? READ_EOF : READ_ERROR;
+    }
+    buffer->end += (size_t)ret;
+  }
+  return READ_OK;
+}
+
+/// Consumes bytes from the receive buffer, reading more from the descriptor if needed.
+/// @return 0 if the bytes were consumed successfully, 1 otherwise.
+static int recv_take(int fd, struct Ring *ring, struct RecvBuffer *buffer, void *dest, size_t len) {
+  if (recv_fill(fd, ring, buffer, len, 1) != READ_OK) {
+    return 1;
+  }
+  memcpy(dest, buffer->data + buffer->start, len);
+  buffer->start += len;
+  return 0;
+}
+
+enum ReadStatus recv_frame(int fd, struct Ring *ring, struct RecvBuffer *buffer, struct Frame *frame,
+                           size_t max_len) {
+  enum ReadStatus status = recv_fill(fd, ring, buffer, FRAME_HEADER_SIZE, 0);
+  if (status != READ_OK) {
+    return status;
+  }
+
+  // The length comes from the peer, so it is checked before anything grows
+  uint32_t len;
+  memcpy(&len, buffer->data + buffer->start + 2, sizeof(uint32_t));
+  if (len > max_len || frame_reserve(frame, len) != 0) {
+    return READ_ERROR;
+  }
+
+  // Nothing is consumed until the whole frame is buffered, so a frame still
+  // arriving is decoded again from its header once the rest comes in
+  status = recv_fill(fd, ring, buffer, FRAME_HEADER_SIZE + len, 0);
+  if (status != READ_OK) {
+    return status;
+  }
+
+  const char *header = buffer->data + buffer->start;
+  frame_reset(frame, header[0], (unsigned char)header[1]);
+  memcpy(frame->data + FRAME_HEADER_SIZE, header + FRAME_HEADER_SIZE, len);
+  frame->len = len;
+  buffer->start += FRAME_HEADER_SIZE + len;
+  return READ_OK;
+}
+
+int recv_has_frame(const struct RecvBuffer *buffer) {
+  if (recv_buffered(buffer) < FRAME_HEADER_SIZE) {
+    return 0;
+  }
+  uint32_t len;
+  memcpy(&len, buffer->data + buffer->start + 2, sizeof(uint32_t));
+  return recv_buffered(buffer) - FRAME_HEADER_SIZE >= len;
+}
+
+int channel_init(struct Channel *channel, int in_fd, int out_fd) {
+  channel->in_fd = in_fd;
+  channel->out_fd = out_fd;
+  channel->in_ring = NULL;
+  channel->out_ring = NULL;
+  channel->send_len = 0;
+  channel->send = malloc(CHANNEL_SEND_SIZE);
+  if (channel->send == NULL) {
+    channel->recv.data = NULL;
+    return 1;
+  }
+  if (recv_buffer_init(&channel->recv) != 0) {
+    free(channel->send);
+    channel->send = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+void channel_attach_rings(struct Channel *channel, struct Ring *in_ring, struct Ring *out_ring) {
+  channel->in_ring = in_ring;
+  channel->out_ring = out_ring;
+}
+
+void channel_free(struct Channel *channel) {
+  free(channel->send);
+  channel->send = NULL;
+  recv_buffer_free(&channel->recv);
+}
+
+int channel_put(struct Channel *channel, const void *data, size_t len) {
+  if (channel->send_len + len <= CHANNEL_SEND_SIZE) {
+    memcpy(channel->send + channel->send_len, data, len);
+    channel->send_len += len;
+    return 0;
+  }
+
+  // Large values, such as a seat grid, go out with what is buffered in a single write
+  if (len >= CHANNEL_SEND_SIZE / 2) {
+    struct iovec iov[] = {{channel->send, channel->send_len}, {(void *)data, len}};
+    channel->send_len = 0;
+    return send_iov(channel->out_fd, channel->out_ring, iov, 2);
+  }
+
+  if (channel_flush(channel) != 0) {
+    return 1;
+  }
+  memcpy(channel->send, data, len);
+  channel->send_len = len;
+  return 0;
+}
+
+int channel_put_int(struct Channel *channel, int value) { return channel_put(channel, &value, sizeof(int)); }
+
+int channel_put_uint(struct Channel *channel, unsigned int value) {
+  return channel_put(channel, &value, sizeof(unsigned int));
+}
+
+int channel_put_sizet(struct Channel *channel, size_t value) { return channel_put(channel, &value, sizeof(size_t)); }
+
+int channel_put_frame(struct Channel *channel, struct Frame *frame) {
+  size_t len = frame_seal(frame);
+  return channel_put(channel, frame->data, len);
+}
+
+int channel_flush(struct Channel *channel) {
+  if (channel->send_len == 0) {
+    return 0;
+  }
+  size_t len = channel->send_len;
+  channel->send_len = 0;
+  return send_all(channel->out_fd, channel->out_ring, channel->send, len);
+}
+
+enum ReadStatus channel_fill(struct Channel *channel, size_t len) {
+  return recv_fill(channel->in_fd, channel->in_ring, &channel->recv, len, 0);
+}
+
+int channel_peek(const struct Channel *channel, size_t offset, void *dest, size_t len) {
+  if (recv_buffered(&channel->recv) < offset + len) {
+    return 1;
+  }
+  memcpy(dest, channel->recv.data + channel->recv.start + offset, len);
+  return 0;
+}
+
+size_t channel_buffered(const struct Channel *channel) { return recv_buffered(&channel->recv); }
+
+int channel_has_frame(const struct Channel *channel) { return recv_has_frame(&channel->recv); }
+
+int channel_get(struct Channel *channel, void *dest, size_t len) {
+  return recv_take(channel->in_fd, channel->in_ring, &channel->recv, dest, len);
+}
+
+int channel_get_int(struct Channel *channel, int *value) { return channel_get(channel, value, sizeof(int)); }
+
+int channel_get_uint(struct Channel *channel, unsigned int *value) {
+  return channel_get(channel, value, sizeof(unsigned int));
+}
+
+enum ReadStatus channel_get_frame(struct Channel *channel, struct Frame *frame, size_t max_len) {
+  return recv_frame(channel->in_fd, channel->in_ring, &channel->recv, frame, max_len);
+}
@@ -2,6 +2,10 @@
 #define COMMON_IO_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct Ring;
 
 /// Parses an unsigned integer from the given file descriptor.
 /// @param fd The file descriptor to read from.
@@ -10,6 +14,12 @@
 /// @return 0 if the integer was read successfully, 1 otherwise.
 int parse_uint(int fd, unsigned int *value, char *next);
 
+/// Formats an unsigned integer in decimal into the given buffer. No null terminator is written.
+/// @param buf Buffer to write to, with room for at least 10 characters.
+/// @param value The value to format.
+/// @return Number of characters written.
+size_t format_uint(char *buf, unsigned int value);
+
 /// Prints an unsigned integer to the given file descriptor.
 /// @param fd The file descriptor to write to.
 /// @param value The value to write.
@@ -73,4 +83,265 @@ int read_uint(int fd, unsigned int *i);
 int read_sizet(int fd, size_t *i);
 
 
+#define PROTOCOL_VERSION 1  // Version of the framed protocol
+#define FRAME_HEADER_SIZE 6  // Opcode, flags and 32-bit body length
+#define FRAME_MAX_BODY_SIZE (1u << 30)  // Largest body of any frame, such as the grid of a large event
+
+// Message of the framed protocol: a fixed header with the opcode, flags and body
+// length, followed by a body of varints. The header is kept in front of the body,
+// so a frame is written with a single syscall.
+struct Frame {
+  char op_code;          // Opcode of the message
+  unsigned char flags;   // Reserved for future use, always 0
+  unsigned char *data;   // Header followed by the body
+  size_t len;            // Length of the body
+  size_t capacity;       // Room for the body in data
+  size_t pos;            // Position of the next value to decode
+};
+
+enum ReadStatus {
+  READ_OK,     // A message was read
+  READ_ERROR,  // The descriptor failed or the message was truncated
+  READ_EOF,    // The descriptor reached end of file before a message started
+  READ_AGAIN,  // A non-blocking descriptor had no message yet
+};
+
+#define RECV_BUFFER_SIZE 65536  // Initial size of a receive buffer
+
+// Bytes read ahead from a descriptor, so messages are decoded from memory
+// instead of with a read per field
+struct RecvBuffer {
+  char *data;       // Bytes read
+  size_t start;     // Position of the first byte not consumed
+  size_t end;       // Position after the last byte read
+  size_t capacity;  // Size of data
+};
+
+#define CHANNEL_SEND_SIZE 65536  // Size of the send buffer of a channel
+
+// Buffered connection to a peer. Values put in the channel are only sent when it
+// is flushed, at the end of a message or batch of messages, or when the send
+// buffer fills up; values are taken from a receive buffer filled with large reads.
+struct Channel {
+  int in_fd;                 // Descriptor to receive from
+  int out_fd;                // Descriptor to send to
+  struct Ring *in_ring;      // Ring standing in for in_fd, NULL if not shared memory
+  struct Ring *out_ring;     // Ring standing in for out_fd, NULL if not shared memory
+  struct RecvBuffer recv;    // Bytes received and not taken yet
+  char *send;                // Bytes put and not flushed yet
+  size_t send_len;           // Number of bytes in send
+};
+
+/// Initializes an empty frame.
+/// @param frame Frame to be initialized.
+/// @return 0 if the frame was initialized successfully, 1 otherwise.
+int frame_init(struct Frame *frame);
+
+/// Releases the memory of a frame.
+/// @param frame Frame to be released.
+void frame_free(struct Frame *frame);
+
+/// Empties a frame to encode a new message.
+/// @param frame Frame to be reset.
+/// @param op_code Opcode of the message.
+/// @param flags Flags of the message, 0 as none are defined yet.
+void frame_reset(struct Frame *frame, char op_code, unsigned char flags);
+
+/// Appends an unsigned varint (LEB128) to the body of a frame.
+/// @param frame Frame to be modified.
+/// @param value The value to append.
+/// @return 0 if the value was appended successfully, 1 otherwise.
+int frame_put_varint(struct Frame *frame, uint64_t value);
+
+/// Appends a signed varint, zigzag encoded, to the body of a frame.
+/// @param frame Frame to be modified.
+/// @param value The value to append.
+/// @return 0 if the value was appended successfully, 1 otherwise.
+int frame_put_svarint(struct Frame *frame, int64_t value);
+
+/// Appends raw bytes, preceded by their length as a varint, to the body of a frame.
+/// @param frame Frame to be modified.
+/// @param data Bytes to append.
+/// @param len Number of bytes.
+/// @return 0 if the bytes were appended successfully, 1 otherwise.
+int frame_put_bytes(struct Frame *frame, const void *data, size_t len);
+
+/// Decodes the next unsigned varint of the body of a frame.
+/// @param frame Frame to be decoded.
+/// @param value Pointer to the variable to store the value in.
+/// @return 0 if the value was decoded successfully, 1 if the body is exhausted or malformed.
+int frame_get_varint(struct Frame *frame, uint64_t *value);
+
+/// Decodes the next signed varint of the body of a frame.
+/// @param frame Frame to be decoded.
+/// @param value Pointer to the variable to store the value in.
+/// @return 0 if the value was decoded successfully, 1 if the body is exhausted or malformed.
+int frame_get_svarint(struct Frame *frame, int64_t *value);
+
+/// Decodes the next length-prefixed bytes of the body of a frame, without copying them.
+/// @param frame Frame to be decoded.
+/// @param data Pointer to store the address of the bytes in, valid until the frame changes.
+/// @param len Pointer to the variable to store the number of bytes in.
+/// @return 0 if the bytes were decoded successfully, 1 if the body is exhausted or malformed.
+int frame_get_bytes(struct Frame *frame, const void **data, size_t *len);
+
+/// Writes a frame to the given file descriptor.
+/// @param fd The file descriptor to write to.
+/// @param frame Frame to be written.
+/// @return 0 if the frame was written successfully, 1 otherwise.
+int write_frame(int fd, struct Frame *frame);
+
+/// Reads a frame from the given file descriptor, replacing the contents of the frame.
+/// @param fd The file descriptor to read from.
+/// @param frame Frame to store the message in.
+/// @return The ReadStatus of the read.
+enum ReadStatus read_frame(int fd, struct Frame *frame);
+
+/// Initializes an empty receive buffer of RECV_BUFFER_SIZE bytes.
+/// @param buffer Buffer to be initialized.
+/// @return 0 if the buffer was initialized successfully, 1 otherwise.
+int recv_buffer_init(struct RecvBuffer *buffer);
+
+/// Releases the memory of a receive buffer.
+/// @param buffer Buffer to be released.
+void recv_buffer_free(struct RecvBuffer *buffer);
+
+/// Returns the number of bytes read ahead and not consumed yet.
+/// @param buffer Buffer to check.
+/// @return The number of bytes buffered.
+size_t recv_buffered(const struct RecvBuffer *buffer);
+
+/// Reads from the descriptor, as much as fits at a time, until the buffer holds
+/// at least the given number of bytes.
+/// @param fd The file descriptor to read from.
+/// @param ring Ring standing in for the descriptor, NULL to read the descriptor itself.
+/// @param buffer Buffer to fill.
+/// @param needed Number of bytes the buffer must hold.
+/// @param wait Whether to wait on a non-blocking descriptor. If not, READ_AGAIN is
+/// returned as soon as the descriptor has nothing to read, keeping what was read.
+/// @return The ReadStatus of the read. READ_EOF means the buffer was empty at end of file.
+enum ReadStatus recv_fill(int fd, struct Ring *ring, struct RecvBuffer *buffer, size_t needed, int wait);
+
+/// Reads a frame through a receive buffer, replacing the contents of the frame.
+/// @note Never waits on a non-blocking descriptor: a frame that has not fully
+/// arrived is left in the buffer and READ_AGAIN is returned.
+/// @param fd The file descriptor to read from.
+/// @param ring Ring standing in for the descriptor, NULL to read the descriptor itself.
+/// @param buffer Buffer to read through.
+/// @param frame Frame to store the message in.
+/// @param max_len Largest body accepted. Longer frames are rejected before any memory is allocated.
+/// @return The ReadStatus of the read.
+enum ReadStatus recv_frame(int fd, struct Ring *ring, struct RecvBuffer *buffer, struct Frame *frame,
+                           size_t max_len);
+
+/// Checks whether a whole frame is buffered.
+/// @param buffer Buffer to check.
+/// @return Non-zero if a whole frame is buffered, 0 otherwise.
+int recv_has_frame(const struct RecvBuffer *buffer);
+
+/// Initializes a channel over the given descriptors, which stay owned by the caller.
+/// @param channel Channel to be initialized.
+/// @param in_fd Descriptor to receive from.
+/// @param out_fd Descriptor to send to. May be the same as in_fd.
+/// @return 0 if the channel was initialized successfully, 1 otherwise.
+int channel_init(struct Channel *channel, int in_fd, int out_fd);
+
+/// Makes a channel move its bytes through shared-memory rings instead of the
+/// kernel objects its descriptors refer to.
+/// @param channel Channel to be modified.
+/// @param in_ring Ring to receive from.
+/// @param out_ring Ring to send to.
+void channel_attach_rings(struct Channel *channel, struct Ring *in_ring, struct Ring *out_ring);
+
+/// Releases the buffers of a channel, dropping anything not flushed.
+/// @param channel Channel to be released.
+void channel_free(struct Channel *channel);
+
+/// Appends bytes to the send buffer, sending them right away if they do not fit.
+/// @param channel Channel to send through.
+/// @param data Bytes to send.
+/// @param len Number of bytes to send.
+/// @return 0 if the bytes were buffered or sent successfully, 1 otherwise.
+int channel_put(struct Channel *channel, const void *data, size_t len);
+
+/// Appends an int to the send buffer.
+/// @param channel Channel to send through.
+/// @param value The value to send.
+/// @return 0 if the value was buffered successfully, 1 otherwise.
+int channel_put_int(struct Channel *channel, int value);
+
+/// Appends an unsigned int to the send buffer.
+/// @param channel Channel to send through.
+/// @param value The value to send.
+/// @return 0 if the value was buffered successfully, 1 otherwise.
+int channel_put_uint(struct Channel *channel, unsigned int value);
+
+/// Appends a size_t to the send buffer.
+/// @param channel Channel to send through.
+/// @param value The value to send.
+/// @return 0 if the value was buffered successfully, 1 otherwise.
+int channel_put_sizet(struct Channel *channel, size_t value);
+
+/// Appends a frame to the send buffer.
+/// @param channel Channel to send through.
+/// @param frame Frame to send.
+/// @return 0 if the frame was buffered successfully, 1 otherwise.
+int channel_put_frame(struct Channel *channel, struct Frame *frame);
+
+/// Sends everything in the send buffer.
+/// @param channel Channel to flush.
+/// @return 0 if the buffer was sent successfully, 1 otherwise.
+int channel_flush(struct Channel *channel);
+
+/// Receives until a number of bytes is buffered, without waiting on a
+/// non-blocking descriptor.
+/// @param channel Channel to receive from.
+/// @param len Number of bytes that must be buffered.
+/// @return The ReadStatus of the read: READ_OK once len bytes are buffered.
+enum ReadStatus channel_fill(struct Channel *channel, size_t len);
+
+/// Copies buffered bytes without taking them.
+/// @param channel Channel to copy from.
+/// @param offset Offset of the bytes from the first byte not taken yet.
+/// @param dest Where to copy the bytes to.
+/// @param len Number of bytes to copy.
+/// @return 0 if the bytes were copied successfully, 1 if they are not all buffered.
+int channel_peek(const struct Channel *channel, size_t offset, void *dest, size_t len);
+
+/// Returns the number of bytes received and not taken yet.
+/// @param channel Channel to check.
+/// @return The number of bytes buffered.
+size_t channel_buffered(const struct Channel *channel);
+
+/// Checks whether a whole frame was received and not taken yet.
+/// @param channel Channel to check.
+/// @return Non-zero if a whole frame is buffered, 0 otherwise.
+int channel_has_frame(const struct Channel *channel);
+
+/// Takes bytes from the channel, receiving more if needed.
+/// @param channel Channel to receive from.
+/// @param dest Where to copy the bytes to.
+/// @param len Number of bytes to take.
+/// @return 0 if the bytes were taken successfully, 1 otherwise.
+int channel_get(struct Channel *channel, void *dest, size_t len);
+
+/// Takes an int from the channel.
+/// @param channel Channel to receive from.
+/// @param value Pointer to the variable to store the value in.
+/// @return 0 if the value was taken successfully, 1 otherwise.
+int channel_get_int(struct Channel *channel, int *value);
+
+/// Takes an unsigned int from the channel.
+/// @param channel Channel to receive from.
+/// @param value Pointer to the variable to store the value in.
+/// @return 0 if the value was taken successfully, 1 otherwise.
+int channel_get_uint(struct Channel *channel, unsigned int *value);
+
+/// Takes a frame from the channel, replacing the contents of the frame.
+/// @param channel Channel to receive from.
+/// @param frame Frame to store the message in.
+/// @param max_len Largest body accepted, at most FRAME_MAX_BODY_SIZE.
+/// @return The ReadStatus of the read.
+enum ReadStatus channel_get_frame(struct Channel *channel, struct Frame *frame, size_t max_len);
+
 #endif  // COMMON_IO_H
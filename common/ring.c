@@ -0,0 +1,194 @@
+#define _GNU_SOURCE  // syscall()
+
+#include "ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_SPIN_COUNT 256      // Polls of the ring before going to sleep
+#define RING_LIVENESS_CHECK_S 1  // Sleep time after which the peer is checked to be alive
+
+/// Sleeps while the given word holds the expected value, or until the liveness check is due.
+static void futex_wait(_Atomic uint32_t* word, uint32_t expected) {
+  struct timespec timeout = {RING_LIVENESS_CHECK_S, 0};
+  syscall(SYS_futex, word, FUTEX_WAIT, expected, &timeout, NULL, 0);
+}
+
+/// Wakes the process sleeping on the given word.
+static void futex_wake(_Atomic uint32_t* word) { syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0); }
+
+/// Checks whether a peer process has died.
+/// @param pid Process to check, 0 if unknown.
+/// @return Non-zero if the process no longer exists.
+static int peer_died(pid_t pid) { return pid != 0 && kill(pid, 0) == -1 && errno == ESRCH; }
+
+/// Waits until the given word no longer holds the expected value.
+/// @param word Word to watch.
+/// @param expected Value the word held when the ring was found empty or full.
+/// @param waiting Flag telling the other side that this side sleeps on the word.
+/// @param ring Ring the word belongs to.
+/// @param peer Process on the other side of the ring.
+/// @return 0 once the word changed, 1 if the ring was closed or the peer died.
+static int wait_change(_Atomic uint32_t* word, uint32_t expected, _Atomic uint32_t* waiting, struct Ring* ring,
+                       pid_t peer) {
+  for (int i = 0; i < RING_SPIN_COUNT; i++) {
+    if (atomic_load_explicit(word, memory_order_acquire) != expected) {
+      return 0;
+    }
+  }
+
+  while (1) {
+    // Announce the sleep before the last check, so the other side either sees the
+    // flag or this side sees the new value
+    atomic_store(waiting, 1);
+    if (atomic_load(word) != expected) {
+      atomic_store(waiting, 0);
+      return 0;
+    }
+    if (atomic_load(&ring->closed)) {
+      atomic_store(waiting, 0);
+      return 1;
+    }
+
+    futex_wait(word, expected);
+    atomic_store(waiting, 0);
+
+    if (atomic_load(word) != expected) {
+      return 0;
+    }
+    if (peer_died(peer)) {
+      atomic_store(&ring->closed, 1);
+      return 1;
+    }
+  }
+}
+
+ssize_t ring_read(struct Ring* ring, void* buf, size_t len) {
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+  while (head == tail) {
+    if (wait_change(&ring->head, head, &ring->consumer_waiting, ring, ring->producer_pid) != 0) {
+      // Deliver what the producer wrote before closing
+      head = atomic_load_explicit(&ring->head, memory_order_acquire);
+      if (head == tail) {
+        return 0;
+      }
+      break;
+    }
+    head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  }
+
+  size_t available = head - tail;
+  if (len > available) {
+    len = available;
+  }
+
+  // Copy in up to two pieces, as the bytes may wrap around the end of the buffer
+  size_t offset = tail & (RING_SIZE - 1);
+  size_t first = RING_SIZE - offset < len ? RING_SIZE - offset : len;
+  memcpy(buf, ring->data + offset, first);
+  memcpy((char*)buf + first, ring->data, len - first);
+
+  atomic_store(&ring->tail, tail + (uint32_t)len);
+  if (atomic_load(&ring->producer_waiting)) {
+    futex_wake(&ring->tail);
+  }
+
+  return (ssize_t)len;
+}
+
+ssize_t ring_write(struct Ring* ring, const void* buf, size_t len) {
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+  while (head - tail == RING_SIZE) {
+    if (wait_change(&ring->tail, tail, &ring->producer_waiting, ring, ring->consumer_pid) != 0) {
+      errno = EPIPE;
+      return -1;
+    }
+    tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  }
+  if (atomic_load_explicit(&ring->closed, memory_order_relaxed)) {
+    errno = EPIPE;
+    return -1;
+  }
+
+  size_t space = RING_SIZE - (head - tail);
+  if (len > space) {
+    len = space;
+  }
+
+  size_t offset = head & (RING_SIZE - 1);
+  size_t first = RING_SIZE - offset < len ? RING_SIZE - offset : len;
+  memcpy(ring->data + offset, buf, first);
+  memcpy(ring->data, (const char*)buf + first, len - first);
+
+  atomic_store(&ring->head, head + (uint32_t)len);
+  if (atomic_load(&ring->consumer_waiting)) {
+    futex_wake(&ring->head);
+  }
+
+  return (ssize_t)len;
+}
+
+struct ShmSegment* shm_segment_create(const char* name, int* fd) {
+  *fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (*fd == -1) {
+    return NULL;
+  }
+
+  if (ftruncate(*fd, sizeof(struct ShmSegment)) != 0) {
+    close(*fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  // A new shared mapping is zero-filled, which leaves both rings empty and open
+  struct ShmSegment* segment = mmap(NULL, sizeof(struct ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+  if (segment == MAP_FAILED) {
+    close(*fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  segment->request.producer_pid = getpid();
+  segment->response.consumer_pid = getpid();
+  return segment;
+}
+
+struct ShmSegment* shm_segment_open(const char* name, int* fd) {
+  *fd = shm_open(name, O_RDWR, 0);
+  if (*fd == -1) {
+    return NULL;
+  }
+  shm_unlink(name);
+
+  struct ShmSegment* segment = mmap(NULL, sizeof(struct ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+  if (segment == MAP_FAILED) {
+    close(*fd);
+    return NULL;
+  }
+
+  segment->request.consumer_pid = getpid();
+  segment->response.producer_pid = getpid();
+  return segment;
+}
+
+void shm_segment_close(struct ShmSegment* segment) {
+  struct Ring* rings[] = {&segment->request, &segment->response};
+  for (int i = 0; i < 2; i++) {
+    atomic_store(&rings[i]->closed, 1);
+    futex_wake(&rings[i]->head);
+    futex_wake(&rings[i]->tail);
+  }
+  munmap(segment, sizeof(struct ShmSegment));
+}
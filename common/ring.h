@@ -0,0 +1,60 @@
+#ifndef COMMON_RING_H
+#define COMMON_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define RING_SIZE 65536  // Must be a power of two
+
+// Single-producer single-consumer byte ring living in shared memory. The sides
+// only sleep on a futex when the ring is empty (consumer) or full (producer).
+struct Ring {
+  _Atomic uint32_t head;              // Total bytes written, only advanced by the producer
+  _Atomic uint32_t tail;              // Total bytes read, only advanced by the consumer
+  _Atomic uint32_t consumer_waiting;  // Set while the consumer sleeps on head
+  _Atomic uint32_t producer_waiting;  // Set while the producer sleeps on tail
+  _Atomic uint32_t closed;            // Set once either side is done with the ring
+  pid_t producer_pid;                 // Producer process, to detect a producer that died
+  pid_t consumer_pid;                 // Consumer process, to detect a consumer that died
+  char data[RING_SIZE];
+};
+
+// Shared-memory segment with the two rings of a session
+struct ShmSegment {
+  struct Ring request;   // Requests, from the client to the server
+  struct Ring response;  // Responses, from the server to the client
+};
+
+/// Creates and maps a new shared-memory segment.
+/// @param name Name of the segment.
+/// @param fd Pointer to the variable to store the segment descriptor in.
+/// @return The mapped segment, NULL on failure.
+struct ShmSegment* shm_segment_create(const char* name, int* fd);
+
+/// Maps an existing shared-memory segment and removes its name.
+/// @param name Name of the segment.
+/// @param fd Pointer to the variable to store the segment descriptor in.
+/// @return The mapped segment, NULL on failure.
+struct ShmSegment* shm_segment_open(const char* name, int* fd);
+
+/// Closes both rings of a segment and unmaps it.
+/// @param segment Segment to be closed.
+void shm_segment_close(struct ShmSegment* segment);
+
+/// Reads up to len bytes from the ring, waiting while it is empty.
+/// @param ring Ring to read from.
+/// @param buf Buffer to store the bytes in.
+/// @param len Maximum number of bytes to read.
+/// @return Number of bytes read, 0 if the ring is closed and drained.
+ssize_t ring_read(struct Ring* ring, void* buf, size_t len);
+
+/// Writes up to len bytes to the ring, waiting while it is full.
+/// @param ring Ring to write to.
+/// @param buf Bytes to write.
+/// @param len Maximum number of bytes to write.
+/// @return Number of bytes written, -1 if the ring is closed.
+ssize_t ring_write(struct Ring* ring, const void* buf, size_t len);
+
+#endif  // COMMON_RING_H
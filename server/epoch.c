@@ -0,0 +1,154 @@
+#include "epoch.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Read section state of a thread. Records are reused by later threads once
+// their thread exits, and are never freed.
+struct EpochRecord {
+  _Atomic uint64_t epoch;     // Epoch the thread entered its read section in, 0 if outside
+  atomic_int in_use;          // Whether a thread owns the record
+  struct EpochRecord *next;   // Next record, immutable once published
+};
+
+// Memory waiting for its readers to leave
+struct Retired {
+  void *ptr;                   // Memory to be freed
+  void (*free_fn)(void *);     // Function that frees it
+  uint64_t epoch;              // Epoch the memory was unlinked in
+  struct Retired *next;        // Next retired memory
+};
+
+static _Atomic uint64_t global_epoch = 1;
+static _Atomic(struct EpochRecord *) records = NULL;
+static pthread_mutex_t records_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct Retired *retired = NULL;
+static pthread_mutex_t retired_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t record_key;
+static pthread_once_t record_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local struct EpochRecord *local_record = NULL;
+
+/// Releases the record of an exiting thread for reuse.
+static void release_record(void *arg) {
+  struct EpochRecord *record = arg;
+  atomic_store(&record->epoch, 0);
+  atomic_store(&record->in_use, 0);
+}
+
+static void create_record_key(void) {
+  if (pthread_key_create(&record_key, release_record) != 0) {
+    fprintf(stderr, "Failed to create epoch record key\n");
+  }
+}
+
+/// Gives the calling thread a record, reusing one released by an exited thread if possible.
+/// @return The record of the thread, NULL on failure.
+static struct EpochRecord *register_thread(void) {
+  pthread_once(&record_key_once, create_record_key);
+
+  pthread_mutex_lock(&records_lock);
+
+  struct EpochRecord *record = atomic_load(&records);
+  while (record != NULL && atomic_load(&record->in_use)) {
+    record = record->next;
+  }
+
+  if (record == NULL) {
+    record = malloc(sizeof(struct EpochRecord));
+    if (record == NULL) {
+      pthread_mutex_unlock(&records_lock);
+      return NULL;
+    }
+    atomic_init(&record->epoch, 0);
+    record->next = atomic_load(&records);
+    atomic_store(&records, record);
+  }
+  atomic_store(&record->in_use, 1);
+
+  pthread_mutex_unlock(&records_lock);
+
+  pthread_setspecific(record_key, record);
+  local_record = record;
+  return record;
+}
+
+int epoch_enter(void) {
+  struct EpochRecord *record = local_record;
+  if (record == NULL && (record = register_thread()) == NULL) {
+    fprintf(stderr, "Failed to register epoch record\n");
+    return 1;
+  }
+
+  // The fence orders the announcement before any read of shared state, pairing
+  // with the fence a writer issues between unlinking memory and scanning records
+  atomic_store_explicit(&record->epoch, atomic_load_explicit(&global_epoch, memory_order_relaxed),
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  return 0;
+}
+
+void epoch_exit(void) { atomic_store_explicit(&local_record->epoch, 0, memory_order_release); }
+
+int epoch_retire(void *ptr, void (*free_fn)(void *)) {
+  struct Retired *entry = malloc(sizeof(struct Retired));
+  if (entry == NULL) {
+    fprintf(stderr, "Failed to retire memory\n");
+    return 1;
+  }
+  entry->ptr = ptr;
+  entry->free_fn = free_fn;
+
+  // Readers that enter from now on cannot reach the memory, and announce a later epoch
+  entry->epoch = atomic_fetch_add(&global_epoch, 1);
+
+  pthread_mutex_lock(&retired_lock);
+  entry->next = retired;
+  retired = entry;
+  pthread_mutex_unlock(&retired_lock);
+
+  epoch_reclaim();
+  return 0;
+}
+
+void epoch_reclaim(void) {
+  atomic_thread_fence(memory_order_seq_cst);
+
+  // Oldest epoch a reader may still be in
+  uint64_t oldest = UINT64_MAX;
+  for (struct EpochRecord *record = atomic_load(&records); record != NULL; record = record->next) {
+    uint64_t epoch = atomic_load(&record->epoch);
+    if (epoch != 0 && epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+
+  pthread_mutex_lock(&retired_lock);
+  struct Retired **link = &retired;
+  while (*link != NULL) {
+    struct Retired *entry = *link;
+    if (entry->epoch < oldest) {
+      *link = entry->next;
+      entry->free_fn(entry->ptr);
+      free(entry);
+    } else {
+      link = &entry->next;
+    }
+  }
+  pthread_mutex_unlock(&retired_lock);
+}
+
+void epoch_drain(void) {
+  pthread_mutex_lock(&retired_lock);
+  while (retired != NULL) {
+    struct Retired *entry = retired;
+    retired = entry->next;
+    entry->free_fn(entry->ptr);
+    free(entry);
+  }
+  pthread_mutex_unlock(&retired_lock);
+}
@@ -0,0 +1,27 @@
+#ifndef SERVER_EPOCH_H
+#define SERVER_EPOCH_H
+
+/// Marks the calling thread as reading shared state that writers may retire.
+/// @note Only a store to a record owned by the thread and a fence, so readers on
+/// different cores do not contend on a shared cache line. Sections do not nest.
+/// @return 0 if the thread entered the read section, 1 if it could not be registered.
+int epoch_enter(void);
+
+/// Marks the calling thread as no longer reading shared state.
+void epoch_exit(void);
+
+/// Defers freeing memory unlinked from shared state until no reader that could
+/// still see it remains in its read section.
+/// @note Must be called by a writer after the memory was unlinked.
+/// @param ptr Memory to be freed.
+/// @param free_fn Function that frees the memory.
+/// @return 0 if the memory was retired successfully, 1 otherwise (it is then leaked).
+int epoch_retire(void *ptr, void (*free_fn)(void *));
+
+/// Frees every retired memory whose readers have all left.
+void epoch_reclaim(void);
+
+/// Frees all retired memory, assuming no reader remains.
+void epoch_drain(void);
+
+#endif  // SERVER_EPOCH_H
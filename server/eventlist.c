@@ -1,16 +1,88 @@
 #include "eventlist.h"
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "epoch.h"
+
+#define INITIAL_INDEX_CAPACITY 64
+
+/// Hashes an event id into a slot of an index with the given capacity.
+/// @param event_id Event id.
+/// @param capacity Number of slots in the index (power of two).
+/// @return Slot where the probe sequence for the id starts.
+static size_t index_slot(unsigned int event_id, size_t capacity) {
+  // Fibonacci hashing spreads sequential ids over the whole table
+  uint32_t hash = (uint32_t)event_id * 2654435769u;
+  return (size_t)hash & (capacity - 1);
+}
+
+/// Allocates an empty index.
+/// @param capacity Number of slots in the index (power of two).
+/// @return Newly created index, NULL on failure.
+static struct EventIndex* create_index(size_t capacity) {
+  struct EventIndex* index = malloc(sizeof(struct EventIndex) + capacity * sizeof(_Atomic(struct Event*)));
+  if (!index) return NULL;
+
+  index->capacity = capacity;
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&index->slots[i], NULL);
+  }
+  return index;
+}
+
+/// Inserts an event in the index, assuming there is a free slot.
+/// @param index Index to be modified.
+/// @param event Event to be inserted.
+static void index_insert(struct EventIndex* index, struct Event* event) {
+  size_t slot = index_slot(event->id, index->capacity);
+  while (atomic_load_explicit(&index->slots[slot], memory_order_relaxed) != NULL) {
+    slot = (slot + 1) & (index->capacity - 1);
+  }
+  // Release makes the initialized event visible to readers that find it
+  atomic_store_explicit(&index->slots[slot], event, memory_order_release);
+}
+
+/// Replaces the index of the list by one with twice the capacity, rehashing every event.
+/// @param list Event list to be modified.
+/// @return 0 if the index was resized successfully, 1 otherwise.
+static int grow_index(struct EventList* list) {
+  struct EventIndex* old_index = atomic_load_explicit(&list->index, memory_order_relaxed);
+  struct EventIndex* new_index = create_index(old_index->capacity * 2);
+  if (!new_index) return 1;
+
+  for (size_t i = 0; i < old_index->capacity; i++) {
+    struct Event* event = atomic_load_explicit(&old_index->slots[i], memory_order_relaxed);
+    if (event != NULL) {
+      index_insert(new_index, event);
+    }
+  }
+
+  // Readers may still be probing the old index, so it is freed once they leave
+  atomic_store_explicit(&list->index, new_index, memory_order_release);
+  epoch_retire(old_index, free);
+  return 0;
+}
+
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
   if (!list) return NULL;
-  if (pthread_rwlock_init(&list->rwl, NULL) != 0) {
+  if (pthread_mutex_init(&list->writer_lock, NULL) != 0) {
+    free(list);
+    return NULL;
+  }
+  struct EventIndex* index = create_index(INITIAL_INDEX_CAPACITY);
+  if (!index) {
+    pthread_mutex_destroy(&list->writer_lock);
     free(list);
     return NULL;
   }
-  list->head = NULL;
+  lock_profile_init(&list->writer_profile);
+  atomic_init(&list->index, index);
+  atomic_init(&list->size, 0);
+  atomic_init(&list->head, NULL);
   list->tail = NULL;
   return list;
 }
@@ -18,57 +90,75 @@ struct EventList* create_list() {
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
 
+  // Keep the load factor at or below 1/2 so probe sequences stay short
+  size_t size = atomic_load_explicit(&list->size, memory_order_relaxed);
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_relaxed);
+  if ((size + 1) * 2 > index->capacity && grow_index(list) != 0) return 1;
+
   struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
   if (!new_node) return 1;
 
   new_node->event = event;
-  new_node->next = NULL;
+  atomic_init(&new_node->next, NULL);
 
-  if (list->head == NULL) {
-    list->head = new_node;
-    list->tail = new_node;
+  if (list->tail == NULL) {
+    atomic_store_explicit(&list->head, new_node, memory_order_release);
   } else {
-    list->tail->next = new_node;
-    list->tail = new_node;
+    atomic_store_explicit(&list->tail->next, new_node, memory_order_release);
   }
+  list->tail = new_node;
+
+  index_insert(atomic_load_explicit(&list->index, memory_order_relaxed), event);
+  atomic_store_explicit(&list->size, size + 1, memory_order_release);
 
   return 0;
 }
 
-static void free_event(struct Event* event) {
+int append_if_absent(struct EventList* list, struct Event* event) {
+  if (!list) return -1;
+
+  if (get_event(list, event->id) != NULL) return 1;
+  return append_to_list(list, event) != 0 ? -1 : 0;
+}
+
+void free_event(struct Event* event) {
   if (!event) return;
+  pthread_mutex_destroy(&event->mutex);
   free(event->data);
+  free(event->occupancy);
   free(event);
 }
 
 void free_list(struct EventList* list) {
   if (!list) return;
 
-  struct ListNode* current = list->head;
+  struct ListNode* current = atomic_load(&list->head);
   while (current) {
     struct ListNode* temp = current;
-    current = current->next;
+    current = atomic_load(&current->next);
 
     free_event(temp->event);
     free(temp);
   }
 
+  epoch_drain();
+  free(atomic_load(&list->index));
+  pthread_mutex_destroy(&list->writer_lock);
   free(list);
 }
 
-struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to) {
-  if (!list || !from || !to) return NULL;
-  struct ListNode* current = from;
-
-  while (1) {
-    if (current->event->id == event_id) {
-      return current->event;
-    }
+struct Event* get_event(struct EventList* list, unsigned int event_id) {
+  if (!list) return NULL;
 
-    if (current == to) {
-      return NULL;
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_acquire);
+  size_t slot = index_slot(event_id, index->capacity);
+  struct Event* event;
+  while ((event = atomic_load_explicit(&index->slots[slot], memory_order_acquire)) != NULL) {
+    if (event->id == event_id) {
+      return event;
     }
-
-    current = current->next;
+    slot = (slot + 1) & (index->capacity - 1);
   }
+
+  return NULL;
 }
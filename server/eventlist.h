@@ -2,7 +2,11 @@
 #define SERVER_EVENT_LIST_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "lockprof.h"
 
 struct Event {
   unsigned int id;            /// Event id
@@ -12,42 +16,67 @@ struct Event {
   size_t rows;  /// Number of rows.
 
   unsigned int* data;     /// Array of size rows * cols with the reservations for each seat.
+  uint64_t* occupancy;    /// Bitmap with one bit per seat, set if the seat is reserved.
   pthread_mutex_t mutex;  // Mutex to protect the event
+  struct LockProfile mutex_profile;  // Contention of the mutex, when profiling
 };
 
 struct ListNode {
   struct Event* event;
-  struct ListNode* next;
+  _Atomic(struct ListNode*) next;  // Published with release, read with acquire
+};
+
+// Open addressing hash table of the events, keyed by id. A full table is replaced
+// by a larger copy, so readers holding the old one still see every event it had.
+struct EventIndex {
+  size_t capacity;                   // Number of slots (always a power of two)
+  _Atomic(struct Event*) slots[];    // Events, published with release
 };
 
-// Linked list structure
+// Linked list structure. Readers traverse it and its index without locks, inside
+// an epoch read section; writers serialize on the writer lock.
 struct EventList {
-  struct ListNode* head;  // Head of the list
-  struct ListNode* tail;  // Tail of the list
-  pthread_rwlock_t rwl;   // Mutex to protect the list
+  _Atomic(struct ListNode*) head;     // Head of the list
+  struct ListNode* tail;              // Tail of the list, only used by writers
+  pthread_mutex_t writer_lock;        // Serializes the writers
+  struct LockProfile writer_profile;  // Contention of the writer lock, when profiling
+
+  _Atomic(struct EventIndex*) index;  // Hash index of the events, keyed by id
+  _Atomic size_t size;                // Number of events in the list, published after the event
 };
 
 /// Creates a new event list.
 /// @return Newly created event list, NULL on failure
 struct EventList* create_list();
 
-/// Appends a new node to the list.
+/// Appends a new node to the list and indexes its event by id.
+/// @note Must be called with the writer lock held.
 /// @param list Event list to be modified.
 /// @param data Event to be stored in the new node.
 /// @return 0 if the node was appended successfully, 1 otherwise.
 int append_to_list(struct EventList* list, struct Event* data);
 
+/// Appends an event unless the list already has an event with the same id.
+/// @note Must be called with the writer lock held, which makes the check and the append atomic.
+/// @param list Event list to be modified.
+/// @param event Event to be stored.
+/// @return 0 if the event was appended, 1 if its id is taken, -1 on failure.
+int append_if_absent(struct EventList* list, struct Event* event);
+
+/// Frees an event that is not in a list.
+/// @param event Event to be freed.
+void free_event(struct Event* event);
+
 /// Removes a node from the list.
 /// @param list Event list to be modified.
 /// @return 0 if the node was removed successfully, 1 otherwise.
 void free_list(struct EventList* list);
 
-/// Retrieves an event in the list.
+/// Retrieves an event in the list through the hash index.
+/// @note Safe without locks inside an epoch read section.
 /// @param list Event list to be searched
 /// @param event_id Event id.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to);
+struct Event* get_event(struct EventList* list, unsigned int event_id);
 
 #endif  // SERVER_EVENT_LIST_H
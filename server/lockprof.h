@@ -0,0 +1,59 @@
+#ifndef SERVER_LOCKPROF_H
+#define SERVER_LOCKPROF_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Contention counters of one lock. They are only updated by the holder of the
+// lock, so they need no synchronization of their own; they are atomic only so a
+// report can read them while the lock is in use.
+struct LockProfile {
+  _Atomic uint64_t acquisitions;  // Times the lock was taken
+  _Atomic uint64_t contended;     // Times the lock was taken after waiting for another holder
+  _Atomic uint64_t wait_ns;       // Total time spent waiting for the lock
+  _Atomic uint64_t max_wait_ns;   // Longest wait for the lock
+  _Atomic uint64_t hold_ns;       // Total time the lock was held
+  _Atomic uint64_t max_hold_ns;   // Longest time the lock was held
+  uint64_t acquired_at;           // Instant the current holder took the lock
+};
+
+/// Turns lock profiling on. Must be called before any profiled lock is taken.
+void lock_profile_enable(void);
+
+/// Checks whether lock profiling is on.
+/// @return 1 if locks are profiled, 0 otherwise.
+int lock_profile_enabled(void);
+
+/// Zeroes the counters of a lock.
+/// @param profile Counters to be initialized.
+void lock_profile_init(struct LockProfile *profile);
+
+/// Locks a mutex, recording whether and how long it had to wait when profiling is on.
+/// @param mutex Mutex to be locked.
+/// @param profile Counters of the mutex.
+/// @return The result of pthread_mutex_lock.
+int profiled_lock(pthread_mutex_t *mutex, struct LockProfile *profile);
+
+/// Unlocks a mutex taken with profiled_lock, recording how long it was held when profiling is on.
+/// @param mutex Mutex to be unlocked.
+/// @param profile Counters of the mutex.
+/// @return The result of pthread_mutex_unlock.
+int profiled_unlock(pthread_mutex_t *mutex, struct LockProfile *profile);
+
+/// Formats the header of a lock table.
+/// @param buf Buffer to write to.
+/// @param size Size of the buffer.
+/// @return Number of characters written, as by snprintf.
+int lock_profile_header(char *buf, size_t size);
+
+/// Formats the counters of a lock as a row of a lock table.
+/// @param buf Buffer to write to.
+/// @param size Size of the buffer.
+/// @param name Name of the lock.
+/// @param profile Counters of the lock.
+/// @return Number of characters written, as by snprintf.
+int lock_profile_row(char *buf, size_t size, const char *name, struct LockProfile *profile);
+
+#endif  // SERVER_LOCKPROF_H
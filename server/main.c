@@ -4,27 +4,33 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
 
 #include "common/constants.h"
 #include "common/io.h"
 #include "operations.h"
-#include "parser.h"
+#include "pool.h"
+#include "lockprof.h"
+#include "queue.h"
+#include "stats.h"
+#include "trace.h"
+#include "session.h"
 
-typedef struct {
-  char request_pipe[PIPE_NAME_SIZE];
-  char response_pipe[PIPE_NAME_SIZE];
-} client_pipes;
+#define EPOLL_MAX_EVENTS 64
 
-client_pipes producer_consumer_buffer[MAX_SESSION_COUNT];
-int num_clients = 0;
-int write_idx = 0;
-int read_idx = 0;
-pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t buffer_full = PTHREAD_COND_INITIALIZER;
-pthread_cond_t buffer_empty = PTHREAD_COND_INITIALIZER; 
+struct Queue session_queue;
+struct WorkerPool worker_pool;
+int event_loop = 0;
+int epoll_fd = -1;
+atomic_int next_session_id = 0;
 
 int sig_occured = 0;
 
@@ -43,7 +49,23 @@ static void handle_sigpipe() {
   }
 }
 
-void *execute_session(void *arg){
+static void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [-e] [-P] [-s socket_path] [-w workers] [-W max_workers] [-q queue_depth] [-S stats_path] [-T trace_path] "
+          "<pipe_path> [delay]\n"
+          "  -e  Multiplex all sessions over the workers with epoll, one request at a time\n"
+          "  -P  Profile the contention of the list and event locks, reported with the statistics\n"
+          "  -s  Also accept sessions on a Unix domain socket bound to this path\n"
+          "  -w  Number of worker threads (default: %d)\n"
+          "  -W  Let the pool grow up to this many workers while the queue is backed up\n"
+          "  -q  Depth of the queue between the main thread and the workers (default: %d)\n"
+          "  -S  Write request latency statistics to this file every %d seconds\n"
+          "  -T  Record every request to this file, to be replayed with bench/replay\n",
+          program, MAX_SESSION_COUNT, MAX_SESSION_COUNT, STATS_DUMP_INTERVAL_S);
+}
+
+/// Blocks SIGUSR1 in the calling thread, so only the main thread handles it.
+static void mask_sigusr() {
   sigset_t mask;
   sigemptyset(&mask);
   sigaddset(&mask, SIGUSR1);
@@ -51,160 +73,262 @@ void *execute_session(void *arg){
     fprintf(stderr, "Error masking thread\n");
     exit(EXIT_FAILURE);
   }
+}
+
+/// Serves whole client sessions, one at a time, taken from the session queue.
+void *execute_session(void *arg){
+  mask_sigusr();
 
   int session_id = *(int *)arg;
   while(1){
-    int client_is_executing = 1;
     // Read from Producer-Consumer buffer
-    if (pthread_mutex_lock(&buffer_lock) != 0) {
-      fprintf(stderr, "Error locking mutex\n");
+    struct Session *session;
+    int ret = pool_wait_item(&worker_pool, session_id, (void **)&session);
+    if (ret == 1) {
+      return NULL;
+    }
+    if (ret != 0) {
       exit(EXIT_FAILURE);
     }
 
-    // Wait if buffer is empty
-    while(num_clients == 0) {
-      if(pthread_cond_wait(&buffer_empty, &buffer_lock) != 0){
-        fprintf(stderr, "Error waiting for conditional variable\n");
-        pthread_mutex_unlock(&buffer_lock);
-        exit(EXIT_FAILURE);
-      }
+    session->id = session_id;
+    if (session_open(session) != 0) {
+      free(session);
+      continue;
     }
 
-    client_pipes client = producer_consumer_buffer[read_idx++];
+    while (session_handle_request(session) == 0);
 
-    if(read_idx == MAX_SESSION_COUNT) {
-      read_idx = 0;
+    if (session_close(session) != 0) {
+      exit(EXIT_FAILURE);
     }
+    free(session);
+  }
+}
 
-    num_clients--;
+/// Serves a single session, given as argument, until it ends.
+void *serve_session(void *arg){
+  mask_sigusr();
 
-    if(pthread_cond_signal(&buffer_full) != 0){
-      fprintf(stderr, "Error signaling conditional variable\n");
-      pthread_mutex_unlock(&buffer_lock);
-      exit(EXIT_FAILURE);
-    }
+  struct Session *session = arg;
+  if (session_open(session) != 0) {
+    free(session);
+    return NULL;
+  }
+
+  while (session_handle_request(session) == 0);
 
-    if (pthread_mutex_unlock(&buffer_lock) != 0) {
-      fprintf(stderr, "Error unlocking mutex\n");
+  if (session_close(session) != 0) {
+    exit(EXIT_FAILURE);
+  }
+  free(session);
+  return NULL;
+}
+
+/// Opens a new session and adds its request pipe to the epoll set.
+/// @param session Session to be registered.
+/// @return 0 if the session was registered successfully, 1 otherwise.
+static int register_session(struct Session *session) {
+  session->id = next_session_id++;
+  if (session_open(session) != 0) {
+    return 1;
+  }
+
+  int flags = fcntl(session->req_fd, F_GETFL);
+  if (flags == -1 || fcntl(session->req_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+    fprintf(stderr, "Failed to set pipe as non-blocking\n");
+    session_close(session);
+    return 1;
+  }
+
+  session->registered = 1;
+  struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = session};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, session->req_fd, &event) != 0) {
+    fprintf(stderr, "Error adding session to epoll\n");
+    session_close(session);
+    return 1;
+  }
+
+  return 0;
+}
+
+/// Serves one request of each session with pending input taken from the session queue,
+/// and registers the new sessions found in it.
+void *execute_requests(void *arg){
+  mask_sigusr();
+
+  int worker_id = *(int *)arg;
+  while(1){
+    struct Session *session;
+    int ret = pool_wait_item(&worker_pool, worker_id, (void **)&session);
+    if (ret == 1) {
+      return NULL;
+    }
+    if (ret != 0) {
       exit(EXIT_FAILURE);
     }
-    
-    // abrir response pipe para escrever
-    int client_resp_pipe_fd = open(client.response_pipe, O_WRONLY);
-    if (client_resp_pipe_fd == -1) {
-      fprintf(stderr, "Failed to open pipe\n");
+
+    // Opening the pipes of a new session waits for its client, so it is done here
+    // rather than on the thread that reads registrations
+    if (!session->registered) {
+      if (register_session(session) != 0) {
+        free(session);
+      }
       continue;
     }
-    
-    // abrir request pipe para ler
-    int client_req_pipe_fd = open(client.request_pipe, O_RDONLY);
-    if (client_req_pipe_fd == -1) {
-      fprintf(stderr, "Failed to open pipe\n");
-      close(client_resp_pipe_fd);
+
+    // Requests already read into the session buffer do not wake epoll again, so
+    // they are served before the session is re-armed
+    int ended;
+    do {
+      ended = session_handle_request(session);
+    } while (!ended && session_has_buffered(session));
+
+    if (ended) {
+      // Closing the request pipe also removes it from the epoll set
+      if (session_close(session) != 0) {
+        exit(EXIT_FAILURE);
+      }
+      free(session);
       continue;
     }
 
-    // escrever no response pipe a session_id
-    if(write_int(client_resp_pipe_fd, &session_id) != 0){
-      fprintf(stderr, "Failed to write to pipe\n");
-      client_is_executing = 0;
+    // Re-arm the session so the next request is dispatched to any worker
+    struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = session};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session->req_fd, &event) != 0) {
+      fprintf(stderr, "Error re-arming session\n");
+      session_close(session);
+      free(session);
     }
+  }
+}
 
-    while (client_is_executing) {
-      unsigned int event_id;
-      size_t num_rows, num_columns, num_seats;
-      size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
-      int ret;
+/// Waits for sessions with pending requests and hands them to the workers.
+void *dispatch_sessions(void *arg){
+  (void)arg;
+  mask_sigusr();
 
-      // ler do request pipe
-      char op_code;
-      if(read_str(client_req_pipe_fd, &op_code, sizeof(char)) != 0){
-        fprintf(stderr, "Failed to read from pipe\n");
-        break;
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+  while(1){
+    int num_events = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, -1);
+    if (num_events == -1) {
+      if (errno == EINTR) {
+        continue;
       }
+      fprintf(stderr, "Error waiting for sessions\n");
+      exit(EXIT_FAILURE);
+    }
 
-      int client_id;
-      if(read_int(client_req_pipe_fd, &client_id) != 0){
-        fprintf(stderr, "Failed to write to pipe\n");
-        break;
+    for (int i = 0; i < num_events; i++) {
+      if (queue_push(&session_queue, events[i].data.ptr) != 0 || pool_adjust(&worker_pool) != 0) {
+        exit(EXIT_FAILURE);
       }
+    }
+  }
+}
 
-      switch (op_code) {
-        case '2':
-          client_is_executing = 0;
-          break;
-          
-        case '3':
-          if(parse_create(client_req_pipe_fd, &event_id, &num_rows, &num_columns) != 0){
-            client_is_executing = 0;
-            break;
-          }
-          
-          ret = ems_create(event_id, num_rows, num_columns);
-          if(write_int(client_resp_pipe_fd, &ret) != 0) {
-            fprintf(stderr, "Failed to write to pipe\n");
-            client_is_executing = 0;
-            break;
-          }
-          if(ret != 0){
-            fprintf(stderr, "Failed to create event\n");
-            continue;
-          }
-          
-          break;
-          
-        case '4':
-          if(parse_reserve(client_req_pipe_fd, &event_id, &num_seats, xs, ys) != 0){
-            client_is_executing = 0;
-            break;
-          }
-
-          ret = ems_reserve(event_id, num_seats, xs, ys);
-          if(write_int(client_resp_pipe_fd, &ret) != 0) {
-            fprintf(stderr, "Failed to write to pipe\n");
-            client_is_executing = 0;
-            break;
-          }
-          if(ret != 0){
-            fprintf(stderr, "Failed to reserve seats\n");
-            continue;
-          }        
-          break;
-
-        case '5':
-          if(parse_show(client_req_pipe_fd, &event_id) != 0){
-            client_is_executing = 0;
-            break;
-          }
-          if(ems_show(client_resp_pipe_fd, event_id) != 0){
-            fprintf(stderr, "Failed to show event\n");
-            client_is_executing = 0;
-            break;
-          }
-          break;
-          
-        case '6':
-          if(ems_list_events(client_resp_pipe_fd) != 0){
-            fprintf(stderr, "Failed to list events\n");
-            client_is_executing = 0;
-            break;
-          }
-          break;
+/// Hands a new session to the workers, according to the server mode.
+/// @param session Session to be served. It is freed if it cannot be registered.
+/// @return 0 if the server can keep accepting sessions, 1 otherwise.
+static int submit_session(struct Session *session) {
+  // Shared-memory rings cannot be polled, so those sessions get a thread of their own
+  if (event_loop && session->transport == TRANSPORT_SHM) {
+    session->id = next_session_id++;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &serve_session, session) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      free(session);
+      return 0;
+    }
+    pthread_detach(thread);
+    return 0;
+  }
+
+  // In event-loop mode a worker registers the session when it takes it from the queue
+  session->registered = 0;
+
+  // Write to Producer-Consumer buffer
+  if (queue_push(&session_queue, session) != 0) {
+    free(session);
+    return 1;
+  }
+  return pool_adjust(&worker_pool);
+}
+
+/// Accepts sessions on the Unix domain socket.
+void *accept_sessions(void *arg){
+  mask_sigusr();
+
+  int listen_fd = *(int *)arg;
+  while(1){
+    int conn_fd = accept(listen_fd, NULL, NULL);
+    if (conn_fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      // Only a broken listening socket is fatal. Running out of descriptors or
+      // memory passes once sessions end, so back off and keep accepting
+      if (errno == EBADF || errno == EINVAL) {
+        fprintf(stderr, "Failed to accept connection\n");
+        exit(EXIT_FAILURE);
       }
+      fprintf(stderr, "Failed to accept connection, retrying\n");
+      struct timespec delay = {0, ACCEPT_RETRY_DELAY_MS * 1000000};
+      nanosleep(&delay, NULL);
+      continue;
     }
-    if(close(client_req_pipe_fd) != 0){
-      fprintf(stderr, "Failed to close pipe\n");
-      exit(EXIT_FAILURE);
+
+    struct Session *session = malloc(sizeof(struct Session));
+    if (session == NULL) {
+      fprintf(stderr, "Failed to allocate session\n");
+      close(conn_fd);
+      continue;
     }
-    if(close(client_resp_pipe_fd) != 0){
-      fprintf(stderr, "Failed to close pipe\n");
+    session->transport = TRANSPORT_SOCKET;
+
+    // Give each direction its own descriptor so the session can close both
+    session->req_fd = conn_fd;
+    session->resp_fd = dup(conn_fd);
+    if (session->resp_fd == -1) {
+      fprintf(stderr, "Failed to duplicate socket\n");
+      close(conn_fd);
+      free(session);
+      continue;
+    }
+
+    if (submit_session(session) != 0) {
       exit(EXIT_FAILURE);
     }
-    unlink(client.response_pipe);
-    unlink(client.request_pipe);
   }
 }
 
+/// Creates a Unix domain socket listening on the given path.
+/// @param path Path to bind the socket to.
+/// @return The listening socket, -1 on failure.
+static int listen_socket(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long\n");
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    fprintf(stderr, "Failed to create socket\n");
+    return -1;
+  }
+
+  unlink(path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+    fprintf(stderr, "Failed to listen on socket\n");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
 int main(int argc, char* argv[]) {
   // Change SIGPIPE
   if(signal(SIGPIPE, handle_sigpipe) != 0){
@@ -212,15 +336,72 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  if (argc < 2 || argc > 3) {
-    fprintf(stderr, "Usage: %s\n <pipe_path> [delay]\n", argv[0]);
+  const char* socket_path = NULL;
+  const char* stats_path = NULL;
+  const char* trace_path = NULL;
+  size_t num_workers = MAX_SESSION_COUNT;
+  size_t max_workers = 0;
+  size_t queue_depth = MAX_SESSION_COUNT;
+  int opt;
+  while ((opt = getopt(argc, argv, "ePs:w:W:q:S:T:")) != -1) {
+    switch (opt) {
+      case 'e':
+        event_loop = 1;
+        break;
+      case 's':
+        socket_path = optarg;
+        break;
+      case 'P':
+        lock_profile_enable();
+        break;
+      case 'S':
+        stats_path = optarg;
+        break;
+      case 'T':
+        trace_path = optarg;
+        break;
+      case 'w':
+      case 'W':
+      case 'q': {
+        char* end;
+        unsigned long value = strtoul(optarg, &end, 10);
+        if (*end != '\0' || value == 0 || value > INT_MAX) {
+          fprintf(stderr, "Invalid value for -%c\n", opt);
+          return 1;
+        }
+        if (opt == 'w') {
+          num_workers = (size_t)value;
+        } else if (opt == 'W') {
+          max_workers = (size_t)value;
+        } else {
+          queue_depth = (size_t)value;
+        }
+        break;
+      }
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (max_workers == 0) {
+    max_workers = num_workers;
+  }
+  if (max_workers < num_workers) {
+    fprintf(stderr, "The maximum number of workers must not be lower than the minimum\n");
     return 1;
   }
 
+  if (argc - optind < 1 || argc - optind > 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  const char* server_pipe_path = argv[optind];
+
   char* endptr;
   unsigned int state_access_delay_us = STATE_ACCESS_DELAY_US;
-  if (argc == 3) {
-    unsigned long int delay = strtoul(argv[2], &endptr, 10);
+  if (argc - optind == 2) {
+    unsigned long int delay = strtoul(argv[optind + 1], &endptr, 10);
 
     if (*endptr != '\0' || delay > UINT_MAX) {
       fprintf(stderr, "Invalid delay value or value too large\n");
@@ -235,21 +416,49 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  stats_init();
+  if (stats_path != NULL && stats_start_dump(stats_path, STATS_DUMP_INTERVAL_S) != 0) {
+    fprintf(stderr, "Failed to start statistics dump\n");
+    ems_terminate();
+    return 1;
+  }
+
+  if (trace_path != NULL && trace_open(trace_path) != 0) {
+    fprintf(stderr, "Failed to start request trace\n");
+    ems_terminate();
+    return 1;
+  }
+
+  if (queue_init(&session_queue, queue_depth) != 0) {
+    fprintf(stderr, "Failed to initialize session queue\n");
+    ems_terminate();
+    return 1;
+  }
+
+  if (event_loop) {
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) {
+      fprintf(stderr, "Failed to create epoll instance\n");
+      ems_terminate();
+      return 1;
+    }
+  }
+
   // unlink server pipe
-  unlink(argv[1]);
+  unlink(server_pipe_path);
   
   // criar server pipe
-  if (mkfifo(argv[1], 0664) != 0) {
+  if (mkfifo(server_pipe_path, 0664) != 0) {
     fprintf(stderr, "Failed to create pipe\n");
     ems_terminate();
     return 1;
   }
   
   // abrir server pipe para ler
-  int reg_pipe_fd = open(argv[1], O_RDWR);
+  int reg_pipe_fd = open(server_pipe_path, O_RDWR);
   if (reg_pipe_fd == -1) {
     fprintf(stderr, "Failed to open pipe\n");
-    unlink(argv[1]);
+    unlink(server_pipe_path);
     ems_terminate();
     return 1;
   }
@@ -257,21 +466,38 @@ int main(int argc, char* argv[]) {
   if(signal(SIGUSR1, handle_sigusr) != 0){
     fprintf(stderr, "Error changing signal\n");
     close(reg_pipe_fd);
-    unlink(argv[1]);
+    unlink(server_pipe_path);
     ems_terminate();
     return 1;
   }
   
   // criar threads
-  pthread_t threads[MAX_SESSION_COUNT];
-  int thread_ids[MAX_SESSION_COUNT];
+  if (pool_init(&worker_pool, &session_queue, num_workers, max_workers,
+                event_loop ? &execute_requests : &execute_session) != 0) {
+    fprintf(stderr, "Error creating threads\n");
+    close(reg_pipe_fd);
+    unlink(server_pipe_path);
+    ems_terminate();
+    return 1;
+  }
 
-  for(int i = 0; i < MAX_SESSION_COUNT; i++){
-    thread_ids[i] = i;
-    if(pthread_create(&threads[i], NULL, &execute_session, (void *)&thread_ids[i]) != 0){
-      fprintf(stderr, "Error creating thread\n");
+  pthread_t dispatcher;
+  if (event_loop && pthread_create(&dispatcher, NULL, &dispatch_sessions, NULL) != 0) {
+    fprintf(stderr, "Error creating thread\n");
+    close(reg_pipe_fd);
+    unlink(server_pipe_path);
+    ems_terminate();
+    return 1;
+  }
+
+  int listen_fd = -1;
+  pthread_t acceptor;
+  if (socket_path != NULL) {
+    listen_fd = listen_socket(socket_path);
+    if (listen_fd == -1 || pthread_create(&acceptor, NULL, &accept_sessions, &listen_fd) != 0) {
+      fprintf(stderr, "Failed to accept sessions on socket\n");
       close(reg_pipe_fd);
-      unlink(argv[1]);
+      unlink(server_pipe_path);
       ems_terminate();
       return 1;
     }
@@ -317,52 +543,26 @@ int main(int argc, char* argv[]) {
       }
     }
 
-    client_pipes client;
-    if(read_str(reg_pipe_fd, client.request_pipe, PIPE_NAME_SIZE * sizeof(char)) != 0){
-      fprintf(stderr, "Failed to read from pipe\n");
+    struct Session *session = malloc(sizeof(struct Session));
+    if (session == NULL) {
+      fprintf(stderr, "Failed to allocate session\n");
       break;
     }
-    if(read_str(reg_pipe_fd, client.response_pipe, PIPE_NAME_SIZE * sizeof(char)) != 0){
+    if(read_str(reg_pipe_fd, session->request_pipe, PIPE_NAME_SIZE * sizeof(char)) != 0){
       fprintf(stderr, "Failed to read from pipe\n");
+      free(session);
       break;
     }
-
-    // Write to Producer-Consumer buffer
-    if (pthread_mutex_lock(&buffer_lock) != 0) {
-      fprintf(stderr, "Error locking mutex\n");
-      break;
-    }
-
-    // Wait if buffer is full
-    while(num_clients == MAX_SESSION_COUNT) {
-      if(pthread_cond_wait(&buffer_full, &buffer_lock) != 0){
-        fprintf(stderr, "Error waiting for conditional variable\n");
-        pthread_mutex_unlock(&buffer_lock);
-        continue_running = 0;
-        break;
-      }
-    }
-
-    if(continue_running == 0){
+    if(read_str(reg_pipe_fd, session->response_pipe, PIPE_NAME_SIZE * sizeof(char)) != 0){
+      fprintf(stderr, "Failed to read from pipe\n");
+      free(session);
       break;
     }
 
-    producer_consumer_buffer[write_idx++] = client;
+    // A '7' registers a session over shared memory, whose segment name takes the request pipe field
+    session->transport = setup_code == '7' ? TRANSPORT_SHM : TRANSPORT_FIFO;
 
-    if(write_idx == MAX_SESSION_COUNT) {
-      write_idx = 0;
-    }
-
-    num_clients++;
-
-    if(pthread_cond_signal(&buffer_empty) != 0){
-      fprintf(stderr, "Error signaling conditional variable\n");
-      pthread_mutex_unlock(&buffer_lock);
-      break;
-    }
-
-    if (pthread_mutex_unlock(&buffer_lock) != 0) {
-      fprintf(stderr, "Error unlocking mutex\n");
+    if (submit_session(session) != 0) {
       break;
     }
   }
@@ -372,10 +572,16 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  if (unlink(argv[1]) != 0) {
+  if (unlink(server_pipe_path) != 0) {
     fprintf(stderr, "Failed to unlink FIFO\n");
     return 1;
   }
 
+  if (socket_path != NULL) {
+    close(listen_fd);
+    unlink(socket_path);
+  }
+
+  trace_close();
   ems_terminate();
-}
\ No newline at end of file
+}
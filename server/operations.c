@@ -1,26 +1,193 @@
+#include "operations.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "common/constants.h"
 #include "common/io.h"
+#include "epoch.h"
 #include "eventlist.h"
+#include "lockprof.h"
+#include "stats.h"
 
 static struct EventList* event_list = NULL;
 static unsigned int state_access_delay_us = 0;
 
+// Incremented whenever events are removed or replaced, which invalidates the
+// handles cached by the sessions. Entries from generation 0 are never valid.
+static _Atomic uint64_t state_generation = 1;
+
+// Copy of the seats of one event, taken for a dump of the state
+struct EventSnapshot {
+  unsigned int id;       // Event id
+  size_t rows;           // Number of rows
+  size_t cols;           // Number of columns
+  unsigned int* seats;   // Reservation of each seat, row by row
+};
+
+// Copy of the whole state, written out by a background thread
+struct StateDump {
+  size_t count;                   // Number of events copied
+  struct EventSnapshot* events;   // Copied events, in creation order
+};
+
+// Dumps in flight, so termination waits for them. The lock only guards the count,
+// so a dump is never held up behind the one being written
+static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dump_done = PTHREAD_COND_INITIALIZER;
+static size_t dumps_pending = 0;
+
+// Held by the writer of a dump, so dumps are written one after the other
+static pthread_mutex_t dump_writer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Gets several events from the state in a single access.
+/// @note Will wait once, for all of them, to simulate a real system accessing a costly
+/// memory resource. The index is read without locks; events are never freed while
+/// the server runs.
+/// @param count Number of events to get.
+/// @param event_ids The IDs of the events to get.
+/// @param events Array of count pointers to store each event in, NULL if it is not found.
+static void get_events_with_delay(size_t count, const unsigned int* event_ids, struct Event** events) {
+  uint64_t start = stats_now();
+  struct timespec delay = {0, state_access_delay_us * 1000};
+  nanosleep(&delay, NULL);  // Should not be removed
+
+  if (epoch_enter() != 0) {
+    for (size_t i = 0; i < count; i++) {
+      events[i] = NULL;
+    }
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    events[i] = get_event(event_list, event_ids[i]);
+  }
+  epoch_exit();
+
+  stats_add(STATS_PHASE_STATE, start);
+}
+
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory resource.
 /// @param event_id The ID of the event to get.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-static struct Event* get_event_with_delay(unsigned int event_id, struct ListNode* from, struct ListNode* to) {
-  struct timespec delay = {0, state_access_delay_us * 1000};
-  nanosleep(&delay, NULL);  // Should not be removed
+static struct Event* get_event_with_delay(unsigned int event_id) {
+  struct Event* event;
+  get_events_with_delay(1, &event_id, &event);
+  return event;
+}
+
+/// Locks a mutex, counting the wait in the lock phase of the request being served.
+/// @param mutex Mutex to be locked.
+/// @param profile Contention counters of the mutex.
+/// @return The result of pthread_mutex_lock.
+static int lock_mutex(pthread_mutex_t* mutex, struct LockProfile* profile) {
+  uint64_t start = stats_now();
+  int ret = profiled_lock(mutex, profile);
+  stats_add(STATS_PHASE_LOCK, start);
+  return ret;
+}
+
+void event_cache_init(struct EventCache* cache) {
+  for (size_t i = 0; i < EVENT_CACHE_SIZE; i++) {
+    cache->entries[i].event = NULL;
+    cache->entries[i].generation = 0;
+  }
+  cache->next = 0;
+}
+
+/// Looks up an event among the handles resolved by a session.
+/// @param cache Events resolved by the session, or NULL.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if it is cached and still valid, NULL otherwise.
+static struct Event* cache_lookup(struct EventCache* cache, unsigned int event_id) {
+  if (cache == NULL) {
+    return NULL;
+  }
+
+  uint64_t generation = atomic_load(&state_generation);
+  for (size_t i = 0; i < EVENT_CACHE_SIZE; i++) {
+    struct EventCacheEntry* entry = &cache->entries[i];
+    if (entry->event != NULL && entry->event_id == event_id && entry->generation == generation) {
+      return entry->event;
+    }
+  }
+  return NULL;
+}
+
+/// Records a resolved event in the cache of a session, replacing the oldest entry.
+/// @param cache Events resolved by the session, or NULL.
+/// @param event The resolved event.
+/// @param generation State generation read before the event was resolved.
+static void cache_store(struct EventCache* cache, struct Event* event, uint64_t generation) {
+  if (cache == NULL) {
+    return;
+  }
 
-  return get_event(event_list, event_id, from, to);
+  struct EventCacheEntry* entry = &cache->entries[cache->next];
+  entry->event_id = event->id;
+  entry->event = event;
+  entry->generation = generation;
+  cache->next = (cache->next + 1) % EVENT_CACHE_SIZE;
+}
+
+/// Gets an event, from the cache of the session if possible, or else from the state.
+/// @param cache Events resolved by the session, or NULL.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* resolve_event(struct EventCache* cache, unsigned int event_id) {
+  struct Event* event = cache_lookup(cache, event_id);
+  if (event != NULL) {
+    return event;
+  }
+
+  uint64_t generation = atomic_load(&state_generation);
+  event = get_event_with_delay(event_id);
+
+  if (event != NULL) {
+    cache_store(cache, event, generation);
+  }
+  return event;
+}
+
+/// Gets several events, those the session cached from the cache and all the others
+/// from the state in a single access.
+/// @param cache Events resolved by the session, or NULL.
+/// @param count Number of events to get, at most MAX_TRANSACTION_EVENTS.
+/// @param event_ids The IDs of the events to get.
+/// @param events Array of count pointers to store each event in, NULL if it is not found.
+static void resolve_events(struct EventCache* cache, size_t count, const unsigned int* event_ids,
+                           struct Event** events) {
+  unsigned int missing_ids[MAX_TRANSACTION_EVENTS];
+  size_t missing[MAX_TRANSACTION_EVENTS];  // Index of each missing event in event_ids
+  size_t num_missing = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    events[i] = cache_lookup(cache, event_ids[i]);
+    if (events[i] == NULL) {
+      missing_ids[num_missing] = event_ids[i];
+      missing[num_missing++] = i;
+    }
+  }
+  if (num_missing == 0) {
+    return;
+  }
+
+  uint64_t generation = atomic_load(&state_generation);
+  struct Event* found[MAX_TRANSACTION_EVENTS];
+  get_events_with_delay(num_missing, missing_ids, found);
+
+  for (size_t i = 0; i < num_missing; i++) {
+    events[missing[i]] = found[i];
+    if (found[i] != NULL) {
+      cache_store(cache, found[i], generation);
+    }
+  }
 }
 
 /// Gets the index of a seat.
@@ -31,6 +198,83 @@ static struct Event* get_event_with_delay(unsigned int event_id, struct ListNode
 /// @return Index of the seat.
 static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
 
+/// Checks whether a seat is marked as reserved in the occupancy bitmap.
+/// @param event Event to check.
+/// @param index Index of the seat.
+/// @return Non-zero if the seat is reserved, 0 otherwise.
+static int seat_occupied(struct Event* event, size_t index) { return (event->occupancy[index / 64] >> (index % 64)) & 1; }
+
+/// Flips the occupancy bit of a seat.
+/// @param event Event to modify.
+/// @param index Index of the seat.
+static void toggle_seat(struct Event* event, size_t index) { event->occupancy[index / 64] ^= (uint64_t)1 << (index % 64); }
+
+/// Checks that every seat of a reservation exists in an event.
+/// @param event Event to check.
+/// @param num_seats Number of seats.
+/// @param xs Rows of the seats.
+/// @param ys Columns of the seats.
+/// @return 0 if all the seats exist, 1 otherwise.
+static int check_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+      fprintf(stderr, "Seat out of bounds\n");
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Marks the seats of a reservation in the occupancy bitmap.
+/// @note The seats are marked one by one, so a seat that is already reserved or
+/// repeated within the request is caught by a single bit probe. On failure the
+/// seats marked so far are unmarked.
+/// @param event Event to modify, whose mutex is held and whose seats were checked.
+/// @param num_seats Number of seats.
+/// @param xs Rows of the seats.
+/// @param ys Columns of the seats.
+/// @return 0 if all the seats were free and are now marked, 1 otherwise.
+static int mark_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  for (size_t i = 0; i < num_seats; i++) {
+    size_t index = seat_index(event, xs[i], ys[i]);
+
+    if (seat_occupied(event, index)) {
+      fprintf(stderr, "Seat already reserved\n");
+      while (i-- > 0) {
+        toggle_seat(event, seat_index(event, xs[i], ys[i]));
+      }
+      return 1;
+    }
+
+    toggle_seat(event, index);
+  }
+  return 0;
+}
+
+/// Unmarks the seats of a reservation that mark_seats marked.
+/// @param event Event to modify, whose mutex is held.
+/// @param num_seats Number of seats.
+/// @param xs Rows of the seats.
+/// @param ys Columns of the seats.
+static void unmark_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  for (size_t i = 0; i < num_seats; i++) {
+    toggle_seat(event, seat_index(event, xs[i], ys[i]));
+  }
+}
+
+/// Assigns the marked seats of a reservation to a new reservation id.
+/// @param event Event to modify, whose mutex is held.
+/// @param num_seats Number of seats.
+/// @param xs Rows of the seats.
+/// @param ys Columns of the seats.
+static void assign_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  unsigned int reservation_id = ++event->reservations;
+
+  for (size_t i = 0; i < num_seats; i++) {
+    event->data[seat_index(event, xs[i], ys[i])] = reservation_id;
+  }
+}
+
 int ems_init(unsigned int delay_us) {
   if (event_list != NULL) {
     fprintf(stderr, "EMS state has already been initialized\n");
@@ -49,31 +293,44 @@ int ems_terminate() {
     return 1;
   }
 
-  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  // Let the dumps being written finish, so their output is not cut short
+  pthread_mutex_lock(&dump_lock);
+  while (dumps_pending > 0) {
+    pthread_cond_wait(&dump_done, &dump_lock);
+  }
+  pthread_mutex_unlock(&dump_lock);
+
+  if (pthread_mutex_lock(&event_list->writer_lock) != 0) {
+    fprintf(stderr, "Error locking list writer lock\n");
     return 1;
   }
 
+  atomic_fetch_add(&state_generation, 1);
+  pthread_mutex_unlock(&event_list->writer_lock);
+
   free_list(event_list);
-  pthread_rwlock_unlock(&event_list->rwl);
+  event_list = NULL;
 
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+int ems_create(struct EventCache* cache, unsigned int event_id, size_t num_rows, size_t num_cols) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  // An event this session already resolved exists without asking the state
+  if (cache_lookup(cache, event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
     return 1;
   }
 
-  if (get_event_with_delay(event_id, event_list->head, event_list->tail) != NULL) {
+  // The costly existence check takes no lock, so it does not stall other operations
+  struct Event* existing = get_event_with_delay(event_id);
+
+  if (existing != NULL) {
     fprintf(stderr, "Event already exists\n");
-    pthread_rwlock_unlock(&event_list->rwl);
     return 1;
   }
 
@@ -81,7 +338,6 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
 
   if (event == NULL) {
     fprintf(stderr, "Error allocating memory for event\n");
-    pthread_rwlock_unlock(&event_list->rwl);
     return 1;
   }
 
@@ -90,229 +346,298 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
   event->cols = num_cols;
   event->reservations = 0;
   if (pthread_mutex_init(&event->mutex, NULL) != 0) {
-    pthread_rwlock_unlock(&event_list->rwl);
     free(event);
     return 1;
   }
+  lock_profile_init(&event->mutex_profile);
   event->data = calloc(num_rows * num_cols, sizeof(unsigned int));
+  event->occupancy = calloc((num_rows * num_cols + 63) / 64, sizeof(uint64_t));
 
-  if (event->data == NULL) {
+  if (event->data == NULL || event->occupancy == NULL) {
     fprintf(stderr, "Error allocating memory for event data\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
+    free_event(event);
     return 1;
   }
 
-  if (append_to_list(event_list, event) != 0) {
-    fprintf(stderr, "Error appending event to list\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event->data);
-    free(event);
+  // Publish the event, unless a concurrent CREATE of the same id got there first
+  if (lock_mutex(&event_list->writer_lock, &event_list->writer_profile) != 0) {
+    fprintf(stderr, "Error locking list writer lock\n");
+    free_event(event);
     return 1;
   }
 
-  pthread_rwlock_unlock(&event_list->rwl);
+  int ret = append_if_absent(event_list, event);
+  if (ret == 0) {
+    cache_store(cache, event, atomic_load(&state_generation));
+  }
+
+  profiled_unlock(&event_list->writer_lock, &event_list->writer_profile);
+
+  if (ret != 0) {
+    fprintf(stderr, ret == 1 ? "Event already exists\n" : "Error appending event to list\n");
+    free_event(event);
+    return 1;
+  }
   return 0;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+int ems_reserve(struct EventCache* cache, unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    return 1;
-  }
-
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
-
-  pthread_rwlock_unlock(&event_list->rwl);
+  struct Event* event = resolve_event(cache, event_id);
 
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
+  if (lock_mutex(&event->mutex, &event->mutex_profile) != 0) {
     fprintf(stderr, "Error locking mutex\n");
     return 1;
   }
 
-  for (size_t i = 0; i < num_seats; i++) {
-    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
-      fprintf(stderr, "Seat out of bounds\n");
-      pthread_mutex_unlock(&event->mutex);
-      return 1;
-    }
+  if (check_seats(event, num_seats, xs, ys) != 0 || mark_seats(event, num_seats, xs, ys) != 0) {
+    profiled_unlock(&event->mutex, &event->mutex_profile);
+    return 1;
   }
 
-  for (size_t i = 0; i < event->rows * event->cols; i++) {
-    for (size_t j = 0; j < num_seats; j++) {
-      if (seat_index(event, xs[j], ys[j]) != i) {
-        continue;
-      }
+  assign_seats(event, num_seats, xs, ys);
 
-      if (event->data[i] != 0) {
-        fprintf(stderr, "Seat already reserved\n");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
-      }
+  profiled_unlock(&event->mutex, &event->mutex_profile);
+  return 0;
+}
 
-      break;
-    }
+/// Unlocks the mutexes of several events, in the reverse of the order they were locked in.
+/// @param events Events whose mutexes are held.
+/// @param count Number of events.
+static void unlock_events(struct Event** events, size_t count) {
+  while (count-- > 0) {
+    profiled_unlock(&events[count]->mutex, &events[count]->mutex_profile);
   }
-
-  unsigned int reservation_id = ++event->reservations;
-
-  for (size_t i = 0; i < num_seats; i++) {
-    event->data[seat_index(event, xs[i], ys[i])] = reservation_id;
-  }
-
-  pthread_mutex_unlock(&event->mutex);
-  return 0;
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
-  int ret = 1;
+int ems_reserve_all(struct EventCache* cache, size_t num_events, struct EventSeats* parts) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
-    if(write_int(out_fd, &ret) != 0){
-      fprintf(stderr, "Failed to write to pipe\n");
-      return 1;
-    }
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    if(write_int(out_fd, &ret) != 0){
-      fprintf(stderr, "Failed to write to pipe\n");
+  if (num_events == 0 || num_events > MAX_TRANSACTION_EVENTS) {
+    fprintf(stderr, "Invalid number of events\n");
+    return 1;
+  }
+
+  // Sort the parts by event id, the order their mutexes are taken in
+  struct EventSeats* sorted[MAX_TRANSACTION_EVENTS];
+  for (size_t i = 0; i < num_events; i++) {
+    size_t j = i;
+    while (j > 0 && sorted[j - 1]->event_id > parts[i].event_id) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    if (j > 0 && sorted[j - 1]->event_id == parts[i].event_id) {
+      fprintf(stderr, "Event repeated in reservation\n");
       return 1;
     }
-    return 1;
+    sorted[j] = &parts[i];
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  unsigned int event_ids[MAX_TRANSACTION_EVENTS];
+  for (size_t i = 0; i < num_events; i++) {
+    event_ids[i] = sorted[i]->event_id;
+  }
 
-  pthread_rwlock_unlock(&event_list->rwl);
+  struct Event* events[MAX_TRANSACTION_EVENTS];
+  resolve_events(cache, num_events, event_ids, events);
 
-  if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
-    if(write_int(out_fd, &ret) != 0){
-      fprintf(stderr, "Failed to write to pipe\n");
+  for (size_t i = 0; i < num_events; i++) {
+    if (events[i] == NULL) {
+      fprintf(stderr, "Event not found\n");
       return 1;
     }
-    return 1;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
-    if(write_int(out_fd, &ret) != 0){
-      fprintf(stderr, "Failed to write to pipe\n");
+  // Every reservation takes the mutexes it needs in ascending id order, so none can
+  // wait for a mutex held by another that waits for one it holds
+  for (size_t i = 0; i < num_events; i++) {
+    if (lock_mutex(&events[i]->mutex, &events[i]->mutex_profile) != 0) {
+      fprintf(stderr, "Error locking mutex\n");
+      unlock_events(events, i);
       return 1;
     }
-    return 1;
   }
 
-  ret = 0;
-  if(write_int(out_fd, &ret) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
-    pthread_mutex_unlock(&event->mutex);
-    return 1;
+  for (size_t i = 0; i < num_events; i++) {
+    if (check_seats(events[i], sorted[i]->num_seats, sorted[i]->xs, sorted[i]->ys) != 0) {
+      unlock_events(events, num_events);
+      return 1;
+    }
   }
 
-  if(write_sizet(out_fd, &(event->rows)) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
-    pthread_mutex_unlock(&event->mutex);
-    return 1;
+  // A seat already reserved in any event undoes the seats marked in the events before it
+  for (size_t i = 0; i < num_events; i++) {
+    if (mark_seats(events[i], sorted[i]->num_seats, sorted[i]->xs, sorted[i]->ys) != 0) {
+      while (i-- > 0) {
+        unmark_seats(events[i], sorted[i]->num_seats, sorted[i]->xs, sorted[i]->ys);
+      }
+      unlock_events(events, num_events);
+      return 1;
+    }
+  }
+
+  for (size_t i = 0; i < num_events; i++) {
+    assign_seats(events[i], sorted[i]->num_seats, sorted[i]->xs, sorted[i]->ys);
   }
-  if(write_sizet(out_fd, &(event->cols)) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
-    pthread_mutex_unlock(&event->mutex);
+
+  unlock_events(events, num_events);
+  return 0;
+}
+
+/// Copies the seats of an event, holding its mutex only for the copy.
+/// @param event Event to be copied.
+/// @param num_rows Pointer to the variable to store the number of rows in.
+/// @param num_cols Pointer to the variable to store the number of columns in.
+/// @param seats Pointer to store the copied seats in. Must be freed by the caller.
+/// @return 0 if the event was copied successfully, 1 otherwise.
+static int copy_seats(struct Event* event, size_t* num_rows, size_t* num_cols, unsigned int** seats) {
+  // The size never changes, so the copy can be allocated before locking
+  size_t rows = event->rows;
+  size_t cols = event->cols;
+  unsigned int* snapshot = malloc(rows * cols * sizeof(unsigned int));
+  if (snapshot == NULL) {
+    fprintf(stderr, "Error allocating memory for event snapshot\n");
     return 1;
   }
 
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      if(write_uint(out_fd, &(event->data[seat_index(event, i, j)])) != 0){
-        fprintf(stderr, "Failed to write to pipe\n");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
-      }
-    }
+  if (lock_mutex(&event->mutex, &event->mutex_profile) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    free(snapshot);
+    return 1;
   }
 
-  pthread_mutex_unlock(&event->mutex);
+  memcpy(snapshot, event->data, rows * cols * sizeof(unsigned int));
+
+  profiled_unlock(&event->mutex, &event->mutex_profile);
+
+  *num_rows = rows;
+  *num_cols = cols;
+  *seats = snapshot;
   return 0;
 }
 
-int ems_list_events(int out_fd) {
-  int ret = 1;
+int ems_show(struct EventCache* cache, unsigned int event_id, size_t* num_rows, size_t* num_cols,
+             unsigned int** seats) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
-    if(write_int(out_fd, &ret) != 0){
-      fprintf(stderr, "Failed to write to pipe\n");
-      return 1;
-    }
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    if(write_int(out_fd, &ret) != 0){
-      fprintf(stderr, "Failed to write to pipe\n");
-      return 1;
-    }
+  struct Event* event = resolve_event(cache, event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  ret = 0;
-  if(write_int(out_fd, &ret) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+  // Snapshot the seats so the mutex is not held while the response is encoded and sent
+  return copy_seats(event, num_rows, num_cols, seats);
+}
+
+int ems_list_events(size_t* num_events, unsigned int** ids) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  struct ListNode* to = event_list->tail;
-  struct ListNode* current = event_list->head;
+  // Nodes are published before the size, so the first count nodes are all visible
+  size_t count = atomic_load_explicit(&event_list->size, memory_order_acquire);
+  unsigned int* snapshot = malloc((count > 0 ? count : 1) * sizeof(unsigned int));
+  if (snapshot == NULL) {
+    fprintf(stderr, "Error allocating memory for event ids\n");
+    return 1;
+  }
 
-  size_t num_events = 0;
-  while(current != NULL){
-    num_events++;
-    
-    if (current == to) {
-      break;
-    }
+  if (epoch_enter() != 0) {
+    free(snapshot);
+    return 1;
+  }
+
+  struct ListNode* current = atomic_load_explicit(&event_list->head, memory_order_acquire);
+  size_t i = 0;
 
-    current = current->next;
+  while (current != NULL && i < count) {
+    snapshot[i++] = current->event->id;
+    current = atomic_load_explicit(&current->next, memory_order_acquire);
   }
 
-  if(write_sizet(out_fd, &num_events) != 0){
-    fprintf(stderr, "Failed to write to pipe\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    return 1;
+  epoch_exit();
+
+  *num_events = i;
+  *ids = snapshot;
+  return 0;
+}
+
+/// Frees a dump of the state.
+/// @param dump Dump to be freed.
+static void free_dump(struct StateDump* dump) {
+  for (size_t i = 0; i < dump->count; i++) {
+    free(dump->events[i].seats);
   }
+  free(dump->events);
+  free(dump);
+}
 
-  current = event_list->head;
+/// Counts a dump as no longer in flight and wakes termination if it was the last.
+static void finish_dump(void) {
+  pthread_mutex_lock(&dump_lock);
+  dumps_pending--;
+  pthread_cond_broadcast(&dump_done);
+  pthread_mutex_unlock(&dump_lock);
+}
 
-  while (current != NULL) {
-    if(write_uint(out_fd, &((current->event)->id)) != 0){
-      fprintf(stderr, "Failed to write to pipe\n");
-      pthread_rwlock_unlock(&event_list->rwl);
-      return 1;
+/// Formats a dump of the state and writes it to stdout in large blocks, then frees it.
+/// @param arg Dump to be written.
+static void* write_dump(void* arg) {
+  struct StateDump* dump = arg;
+
+  pthread_mutex_lock(&dump_writer_lock);
+
+  struct Channel out;
+  if (channel_init(&out, -1, STDOUT_FILENO) != 0) {
+    fprintf(stderr, "Error allocating dump buffer\n");
+  } else {
+    // The dump stops at the first failed write
+    char number[16];
+    int failed = 0;
+    for (size_t e = 0; e < dump->count && !failed; e++) {
+      struct EventSnapshot* event = &dump->events[e];
+
+      failed = channel_put(&out, "Event: ", 7) != 0 || channel_put(&out, number, format_uint(number, event->id)) != 0 ||
+               channel_put(&out, "\n", 1) != 0;
+
+      for (size_t i = 0; i < event->rows && !failed; i++) {
+        for (size_t j = 0; j < event->cols && !failed; j++) {
+          size_t len = format_uint(number, event->seats[i * event->cols + j]);
+          number[len++] = j + 1 < event->cols ? ' ' : '\n';
+          failed = channel_put(&out, number, len) != 0;
+        }
+      }
     }
 
-    if (current == to) {
-      break;
+    if (failed || channel_flush(&out) != 0) {
+      fprintf(stderr, "Error writing dump\n");
     }
-
-    current = current->next;
+    channel_free(&out);
   }
 
-  pthread_rwlock_unlock(&event_list->rwl);
-  return 0;
+  pthread_mutex_unlock(&dump_writer_lock);
+  finish_dump();
+
+  free_dump(dump);
+  return NULL;
 }
 
 int ems_print_all_events(){
@@ -321,58 +646,129 @@ int ems_print_all_events(){
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  struct StateDump* dump = malloc(sizeof(struct StateDump));
+  size_t count = atomic_load_explicit(&event_list->size, memory_order_acquire);
+  if (dump == NULL || (dump->events = malloc((count > 0 ? count : 1) * sizeof(struct EventSnapshot))) == NULL) {
+    fprintf(stderr, "Error allocating memory for dump\n");
+    free(dump);
     return 1;
   }
+  dump->count = 0;
 
-  struct ListNode* to = event_list->tail;
-  struct ListNode* current = event_list->head;
+  if (epoch_enter() != 0) {
+    free_dump(dump);
+    return 1;
+  }
 
-  if(current == NULL) {
-    if(pthread_rwlock_unlock(&event_list->rwl) != 0){
-      fprintf(stderr, "Error unlocking list rwl\n");
+  // Each event is locked only while its seats are copied, so reservations on the
+  // other events carry on; formatting and writing happen after every lock is released
+  struct ListNode* current = atomic_load_explicit(&event_list->head, memory_order_acquire);
+  while (current != NULL && dump->count < count) {
+    struct EventSnapshot* snapshot = &dump->events[dump->count];
+    snapshot->id = current->event->id;
+    if (copy_seats(current->event, &snapshot->rows, &snapshot->cols, &snapshot->seats) != 0) {
+      epoch_exit();
+      free_dump(dump);
       return 1;
     }
+    dump->count++;
+
+    current = atomic_load_explicit(&current->next, memory_order_acquire);
+  }
+
+  epoch_exit();
+
+  pthread_mutex_lock(&dump_lock);
+  dumps_pending++;
+  pthread_mutex_unlock(&dump_lock);
+
+  // The writer inherits a fully blocked mask, so signals keep going to the threads that handle them
+  sigset_t all, previous;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &previous);
+
+  pthread_t writer;
+  int ret = pthread_create(&writer, NULL, &write_dump, dump);
+
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+  if (ret != 0) {
+    fprintf(stderr, "Error creating dump thread\n");
+    finish_dump();
+    free_dump(dump);
+    return 1;
+  }
+  pthread_detach(writer);
+
+  return 0;
+}
+
+/// Checks whether a lock is hotter than another: longer total wait, then more contended, then more used.
+static int hotter(struct LockProfile* a, struct LockProfile* b) {
+  uint64_t a_wait = atomic_load_explicit(&a->wait_ns, memory_order_relaxed);
+  uint64_t b_wait = atomic_load_explicit(&b->wait_ns, memory_order_relaxed);
+  if (a_wait != b_wait) {
+    return a_wait > b_wait;
+  }
+  uint64_t a_contended = atomic_load_explicit(&a->contended, memory_order_relaxed);
+  uint64_t b_contended = atomic_load_explicit(&b->contended, memory_order_relaxed);
+  if (a_contended != b_contended) {
+    return a_contended > b_contended;
+  }
+  return atomic_load_explicit(&a->acquisitions, memory_order_relaxed) >
+         atomic_load_explicit(&b->acquisitions, memory_order_relaxed);
+}
+
+size_t ems_lock_report(char* buf, size_t size) {
+  if (event_list == NULL || size == 0) {
     return 0;
   }
+  if (!lock_profile_enabled()) {
+    int written = snprintf(buf, size, "Lock profiling is off, start the server with -P\n");
+    return written < 0 ? 0 : (size_t)written < size ? (size_t)written : size - 1;
+  }
 
-  while(current != NULL){
-    fprintf(stdout, "Event: %d\n", (current->event)->id);
-    
-    // Show event
-    if (pthread_mutex_lock(&current->event->mutex) != 0) {
-      fprintf(stderr, "Error locking mutex\n");
-      pthread_rwlock_unlock(&event_list->rwl);
-      return 1;
-    }
+  if (epoch_enter() != 0) {
+    return 0;
+  }
 
-    for (size_t i = 1; i <= current->event->rows; i++) {
-      for (size_t j = 1; j <= current->event->cols; j++) {
-        if(j < current->event->cols) {
-          fprintf(stdout, "%d ", current->event->data[seat_index(current->event, i, j)]);
-        }
-        else {
-          fprintf(stdout, "%d\n", current->event->data[seat_index(current->event, i, j)]);
-        }
+  // Keep the hottest events, hottest first, by insertion into a short sorted array
+  struct Event* hot[LOCK_REPORT_TOP_N];
+  size_t num_hot = 0;
+  size_t count = atomic_load_explicit(&event_list->size, memory_order_acquire);
+  struct ListNode* current = atomic_load_explicit(&event_list->head, memory_order_acquire);
+  for (size_t n = 0; current != NULL && n < count; n++) {
+    struct Event* event = current->event;
+    size_t i = num_hot < LOCK_REPORT_TOP_N ? num_hot++ : LOCK_REPORT_TOP_N;
+    while (i > 0 && hotter(&event->mutex_profile, &hot[i - 1]->mutex_profile)) {
+      if (i < LOCK_REPORT_TOP_N) {
+        hot[i] = hot[i - 1];
       }
+      i--;
     }
-
-    if(pthread_mutex_unlock(&current->event->mutex) != 0){
-      fprintf(stderr, "Error unlocking mutex\n");
-      return 1;
+    if (i < LOCK_REPORT_TOP_N) {
+      hot[i] = event;
     }
 
-    if (current == to) {
-      break;
-    }
+    current = atomic_load_explicit(&current->next, memory_order_acquire);
+  }
 
-    current = current->next;
+  size_t len = 0;
+  int written = lock_profile_header(buf, size);
+  len += written > 0 ? (size_t)written : 0;
+  if (len < size) {
+    written = lock_profile_row(buf + len, size - len, "list writer", &event_list->writer_profile);
+    len += written > 0 ? (size_t)written : 0;
   }
 
-  if(pthread_rwlock_unlock(&event_list->rwl) != 0){
-    fprintf(stderr, "Error unlocking list rwl\n");
-    return 1;
+  char name[32];
+  for (size_t i = 0; i < num_hot && len < size; i++) {
+    snprintf(name, sizeof(name), "event %u", hot[i]->id);
+    written = lock_profile_row(buf + len, size - len, name, &hot[i]->mutex_profile);
+    len += written > 0 ? (size_t)written : 0;
   }
-  return 0;
-}
\ No newline at end of file
+
+  epoch_exit();
+
+  return len < size ? len : size - 1;
+}
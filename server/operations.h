@@ -2,6 +2,31 @@
 #define SERVER_OPERATIONS_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+#define EVENT_CACHE_SIZE 8  // Number of events a session keeps resolved
+#define LOCK_REPORT_TOP_N 10  // Number of event mutexes in a lock report
+
+// Event resolved by a session, valid while the state generation is unchanged
+struct EventCacheEntry {
+  unsigned int event_id;  // Id of the event
+  struct Event *event;    // Handle of the event, NULL if the entry is empty
+  uint64_t generation;    // State generation the handle was resolved in
+};
+
+// Events recently used by a session, so repeated operations on them skip the costly lookup
+struct EventCache {
+  struct EventCacheEntry entries[EVENT_CACHE_SIZE];
+  size_t next;  // Entry to be replaced next
+};
+
+// Seats to reserve in one of the events of a reservation that spans several
+struct EventSeats {
+  unsigned int event_id;  // Id of the event
+  size_t num_seats;       // Number of seats to reserve
+  size_t *xs;             // Rows of the seats
+  size_t *ys;             // Columns of the seats
+};
 
 /// Initializes the EMS state.
 /// @param delay_us Delay in microseconds.
@@ -11,32 +36,63 @@ int ems_init(unsigned int delay_us);
 /// Destroys the EMS state.
 int ems_terminate();
 
+/// Empties an event cache.
+/// @param cache Cache to be initialized.
+void event_cache_init(struct EventCache *cache);
+
 /// Creates a new event with the given id and dimensions.
+/// @param cache Events resolved by the calling session, or NULL.
 /// @param event_id Id of the event to be created.
 /// @param num_rows Number of rows of the event to be created.
 /// @param num_cols Number of columns of the event to be created.
 /// @return 0 if the event was created successfully, 1 otherwise.
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
+int ems_create(struct EventCache *cache, unsigned int event_id, size_t num_rows, size_t num_cols);
 
 /// Creates a new reservation for the given event.
+/// @param cache Events resolved by the calling session, or NULL.
 /// @param event_id Id of the event to create a reservation for.
 /// @param num_seats Number of seats to reserve.
 /// @param xs Array of rows of the seats to reserve.
 /// @param ys Array of columns of the seats to reserve.
 /// @return 0 if the reservation was created successfully, 1 otherwise.
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
+int ems_reserve(struct EventCache *cache, unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
+
+/// Creates a reservation in each of the given events, either in all of them or in none.
+/// @note The events that are not cached are looked up together, in a single access
+/// to the state, and their mutexes are taken in ascending id order, so reservations
+/// over overlapping events cannot deadlock.
+/// @param cache Events resolved by the calling session, or NULL.
+/// @param num_events Number of events, at most MAX_TRANSACTION_EVENTS, none of them repeated.
+/// @param parts Seats to reserve in each event.
+/// @return 0 if every reservation was created successfully, 1 otherwise.
+int ems_reserve_all(struct EventCache *cache, size_t num_events, struct EventSeats *parts);
+
+/// Copies the seats of the given event.
+/// @param cache Events resolved by the calling session, or NULL.
+/// @param event_id Id of the event to show.
+/// @param num_rows Pointer to the variable to store the number of rows in.
+/// @param num_cols Pointer to the variable to store the number of columns in.
+/// @param seats Pointer to store the copied seats in, row by row. Must be freed by the caller.
+/// @return 0 if the event was copied successfully, 1 otherwise.
+int ems_show(struct EventCache *cache, unsigned int event_id, size_t *num_rows, size_t *num_cols, unsigned int **seats);
 
-/// Prints the given event.
-/// @param out_fd File descriptor to print the event to.
-/// @param event_id Id of the event to print.
-/// @return 0 if the event was printed successfully, 1 otherwise.
-int ems_show(int out_fd, unsigned int event_id);
+/// Copies the ids of all the events.
+/// @param num_events Pointer to the variable to store the number of events in.
+/// @param ids Pointer to store the copied ids in. Must be freed by the caller.
+/// @return 0 if the ids were copied successfully, 1 otherwise.
+int ems_list_events(size_t *num_events, unsigned int **ids);
 
-/// Prints all the events.
-/// @param out_fd File descriptor to print the events to.
-/// @return 0 if the events were printed successfully, 1 otherwise.
-int ems_list_events(int out_fd);
+/// Reports the contention of the list writer lock and of the most contended event mutexes.
+/// @note Only measured when the server was started with lock profiling on.
+/// @param buf Buffer to write the report to.
+/// @param size Size of the buffer.
+/// @return Length of the report, without the null terminator.
+size_t ems_lock_report(char *buf, size_t size);
 
+/// Dumps the seats of all the events to stdout.
+/// @note The events are copied one at a time, each under its own mutex, and the copy
+/// is formatted and written by a background thread, so the caller returns at once.
+/// @return 0 if the dump was started successfully, 1 otherwise.
 int ems_print_all_events();
 
 #endif  // SERVER_OPERATIONS_H
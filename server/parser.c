@@ -1,18 +1,23 @@
 #include <stddef.h>
 #include <stdio.h>
 
+#include "parser.h"
+
+#include <limits.h>
+
+#include "common/constants.h"
 #include "common/io.h"
 
-int parse_create(int req_fd, unsigned int *event_id, size_t *num_rows, size_t *num_columns) {
-  if(read_uint(req_fd, event_id) != 0){
+int parse_create(struct Channel *channel, unsigned int *event_id, size_t *num_rows, size_t *num_columns) {
+  if(channel_get(channel, event_id, sizeof(unsigned int)) != 0){
     fprintf(stderr, "Failed to read from pipe\n");
     return 1;
   }
-  if(read_sizet(req_fd, num_rows) != 0){
+  if(channel_get(channel, num_rows, sizeof(size_t)) != 0){
     fprintf(stderr, "Failed to read from pipe\n");
     return 1;
   }
-  if(read_sizet(req_fd, num_columns) != 0){
+  if(channel_get(channel, num_columns, sizeof(size_t)) != 0){
     fprintf(stderr, "Failed to read from pipe\n");
     return 1;
   }
@@ -21,36 +26,132 @@ int parse_create(int req_fd, unsigned int *event_id, size_t *num_rows, size_t *n
 }
 
 
-int parse_reserve(int req_fd, unsigned int *event_id, size_t *num_seats, size_t *xs, size_t *ys) {
-  if(read_uint(req_fd, event_id) != 0){
+int parse_reserve(struct Channel *channel, unsigned int *event_id, size_t *num_seats, size_t *xs, size_t *ys) {
+  if(channel_get(channel, event_id, sizeof(unsigned int)) != 0){
+    fprintf(stderr, "Failed to read from pipe\n");
+    return 1;
+  }
+  if(channel_get(channel, num_seats, sizeof(size_t)) != 0){
     fprintf(stderr, "Failed to read from pipe\n");
     return 1;
   }
-  if(read_sizet(req_fd, num_seats) != 0){
+  if(*num_seats > MAX_RESERVATION_SIZE){
+    fprintf(stderr, "Too many seats in reservation\n");
+    return 1;
+  }
+
+  // The coordinates are sent as two contiguous arrays
+  if(channel_get(channel, xs, *num_seats * sizeof(size_t)) != 0){
     fprintf(stderr, "Failed to read from pipe\n");
     return 1;
   }
-  for(size_t i = 0; i < *num_seats; i++){
-    if(read_sizet(req_fd, xs + i) != 0){
-      fprintf(stderr, "Failed to read from pipe\n");
+  if(channel_get(channel, ys, *num_seats * sizeof(size_t)) != 0){
+    fprintf(stderr, "Failed to read from pipe\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+int parse_show(struct Channel *channel, unsigned int *event_id) {
+  if(channel_get(channel, event_id, sizeof(unsigned int)) != 0){
+    fprintf(stderr, "Failed to read from pipe\n");
+    return 1;
+  }
+    
+  return 0;
+}
+
+/// Decodes an event id from a frame.
+static int get_event_id(struct Frame *frame, unsigned int *event_id) {
+  uint64_t value;
+  if(frame_get_varint(frame, &value) != 0 || value > UINT_MAX){
+    return 1;
+  }
+  *event_id = (unsigned int)value;
+  return 0;
+}
+
+/// Decodes a size from a frame.
+static int get_size(struct Frame *frame, size_t *size) {
+  uint64_t value;
+  if(frame_get_varint(frame, &value) != 0 || value > SIZE_MAX){
+    return 1;
+  }
+  *size = (size_t)value;
+  return 0;
+}
+
+/// Decodes delta-encoded coordinates from a frame.
+static int get_coordinates(struct Frame *frame, size_t count, size_t *coordinates) {
+  int64_t previous = 0;
+  for(size_t i = 0; i < count; i++){
+    int64_t delta;
+    if(frame_get_svarint(frame, &delta) != 0){
       return 1;
     }
+    previous += delta;
+    // Negative coordinates are out of bounds anyway, so they become 0
+    coordinates[i] = previous > 0 ? (size_t)previous : 0;
+  }
+  return 0;
+}
+
+int parse_frame_create(struct Frame *frame, unsigned int *event_id, size_t *num_rows, size_t *num_columns) {
+  if(get_event_id(frame, event_id) != 0 || get_size(frame, num_rows) != 0 || get_size(frame, num_columns) != 0){
+    fprintf(stderr, "Malformed create request\n");
+    return 1;
   }
-  for(size_t i = 0; i < *num_seats; i++){
-    if(read_sizet(req_fd, ys + i) != 0){
-      fprintf(stderr, "Failed to read from pipe\n");
+
+  return 0;
+}
+
+int parse_frame_reserve(struct Frame *frame, unsigned int *event_id, size_t *num_seats, size_t *xs, size_t *ys) {
+  if(get_event_id(frame, event_id) != 0 || get_size(frame, num_seats) != 0 || *num_seats > MAX_RESERVATION_SIZE){
+    fprintf(stderr, "Malformed reserve request\n");
+    return 1;
+  }
+  if(get_coordinates(frame, *num_seats, xs) != 0 || get_coordinates(frame, *num_seats, ys) != 0){
+    fprintf(stderr, "Malformed reserve request\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+int parse_frame_reserve_all(struct Frame *frame, size_t *num_events, struct EventSeats *parts, size_t *xs, size_t *ys) {
+  if(get_size(frame, num_events) != 0 || *num_events == 0 || *num_events > MAX_TRANSACTION_EVENTS){
+    fprintf(stderr, "Malformed reserve all request\n");
+    return 1;
+  }
+
+  // The seats of all the events share the arrays, so together they fit a single reservation
+  size_t total = 0;
+  for(size_t i = 0; i < *num_events; i++){
+    struct EventSeats *part = &parts[i];
+    if(get_event_id(frame, &part->event_id) != 0 || get_size(frame, &part->num_seats) != 0 ||
+       part->num_seats > MAX_RESERVATION_SIZE - total){
+      fprintf(stderr, "Malformed reserve all request\n");
+      return 1;
+    }
+    part->xs = xs + total;
+    part->ys = ys + total;
+    if(get_coordinates(frame, part->num_seats, part->xs) != 0 ||
+       get_coordinates(frame, part->num_seats, part->ys) != 0){
+      fprintf(stderr, "Malformed reserve all request\n");
       return 1;
     }
+    total += part->num_seats;
   }
 
   return 0;
 }
 
-int parse_show(int req_fd, unsigned int *event_id) {
-  if(read_uint(req_fd, event_id) != 0){
-    fprintf(stderr, "Failed to read from pipe\n");
+int parse_frame_show(struct Frame *frame, unsigned int *event_id) {
+  if(get_event_id(frame, event_id) != 0){
+    fprintf(stderr, "Malformed show request\n");
     return 1;
   }
-    
+
   return 0;
-}
\ No newline at end of file
+}
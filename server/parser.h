@@ -3,29 +3,64 @@
 
 #include <stddef.h>
 
-/// Parses
-/// @param req_fd
-/// @param event_id
-/// @param num_rows
-/// @param num_columns
-/// @return 0 if the integer was read successfully, 1 otherwise.
-int parse_create(int req_fd, unsigned int *event_id, size_t *num_rows, size_t *num_columns);
-
-
-/// Parses
-/// @param req_fd
-/// @param event_id
-/// @param num_seats
-/// @param xs
-/// @param ys
-/// @return 0 if the integer was read successfully, 1 otherwise.
-int parse_reserve(int req_fd, unsigned int *event_id, size_t *num_seats, size_t *xs, size_t *ys);
-
-/// Parses
-/// @param req_fd
-/// @param event_id
-/// @return 0 if the integer was read successfully, 1 otherwise.
-int parse_show(int req_fd, unsigned int *event_id);
+#include "common/io.h"
+#include "operations.h"
 
+/// Parses the arguments of a CREATE request.
+/// @param channel Channel of the session, positioned at the arguments.
+/// @param event_id Pointer to the variable to store the event id in.
+/// @param num_rows Pointer to the variable to store the number of rows in.
+/// @param num_columns Pointer to the variable to store the number of columns in.
+/// @return 0 if the request was parsed successfully, 1 otherwise.
+int parse_create(struct Channel *channel, unsigned int *event_id, size_t *num_rows, size_t *num_columns);
+
+
+/// Parses the arguments of a RESERVE request.
+/// @param channel Channel of the session, positioned at the arguments.
+/// @param event_id Pointer to the variable to store the event id in.
+/// @param num_seats Pointer to the variable to store the number of seats in.
+/// @param xs Array of MAX_RESERVATION_SIZE rows to fill.
+/// @param ys Array of MAX_RESERVATION_SIZE columns to fill.
+/// @return 0 if the request was parsed successfully, 1 otherwise.
+int parse_reserve(struct Channel *channel, unsigned int *event_id, size_t *num_seats, size_t *xs, size_t *ys);
+
+/// Parses the arguments of a SHOW request.
+/// @param channel Channel of the session, positioned at the arguments.
+/// @param event_id Pointer to the variable to store the event id in.
+/// @return 0 if the request was parsed successfully, 1 otherwise.
+int parse_show(struct Channel *channel, unsigned int *event_id);
+
+/// Parses the body of a framed CREATE request.
+/// @param frame Frame holding the request, positioned at its arguments.
+/// @param event_id Pointer to the variable to store the event id in.
+/// @param num_rows Pointer to the variable to store the number of rows in.
+/// @param num_columns Pointer to the variable to store the number of columns in.
+/// @return 0 if the request was parsed successfully, 1 otherwise.
+int parse_frame_create(struct Frame *frame, unsigned int *event_id, size_t *num_rows, size_t *num_columns);
+
+/// Parses the body of a framed RESERVE request, whose coordinates are delta encoded.
+/// @param frame Frame holding the request, positioned at its arguments.
+/// @param event_id Pointer to the variable to store the event id in.
+/// @param num_seats Pointer to the variable to store the number of seats in.
+/// @param xs Array of MAX_RESERVATION_SIZE rows to fill.
+/// @param ys Array of MAX_RESERVATION_SIZE columns to fill.
+/// @return 0 if the request was parsed successfully, 1 otherwise.
+int parse_frame_reserve(struct Frame *frame, unsigned int *event_id, size_t *num_seats, size_t *xs, size_t *ys);
+
+/// Parses the body of a framed RESERVE_ALL request, which holds the number of events
+/// and then the arguments of a framed RESERVE for each of them.
+/// @param frame Frame holding the request, positioned at its arguments.
+/// @param num_events Pointer to the variable to store the number of events in.
+/// @param parts Array of MAX_TRANSACTION_EVENTS parts to fill, whose seats point into xs and ys.
+/// @param xs Array of MAX_RESERVATION_SIZE rows to fill, with the rows of every event.
+/// @param ys Array of MAX_RESERVATION_SIZE columns to fill, with the columns of every event.
+/// @return 0 if the request was parsed successfully, 1 otherwise.
+int parse_frame_reserve_all(struct Frame *frame, size_t *num_events, struct EventSeats *parts, size_t *xs, size_t *ys);
+
+/// Parses the body of a framed SHOW request.
+/// @param frame Frame holding the request, positioned at its arguments.
+/// @param event_id Pointer to the variable to store the event id in.
+/// @return 0 if the request was parsed successfully, 1 otherwise.
+int parse_frame_show(struct Frame *frame, unsigned int *event_id);
 
 #endif  // SERVER_PARSER_H
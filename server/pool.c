@@ -0,0 +1,139 @@
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common/constants.h"
+#include "queue.h"
+
+/// Starts a worker in a free slot, with the pool lock held.
+/// @param pool Pool to be modified.
+/// @return 0 if the worker was started successfully, 1 otherwise.
+static int start_worker(struct WorkerPool* pool) {
+  size_t slot = 0;
+  while (slot < pool->max_workers && pool->active[slot]) {
+    slot++;
+  }
+  if (slot == pool->max_workers) {
+    return 1;
+  }
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, pool->routine, &pool->ids[slot]) != 0) {
+    fprintf(stderr, "Error creating thread\n");
+    return 1;
+  }
+  pthread_detach(thread);
+
+  pool->active[slot] = 1;
+  pool->num_workers++;
+  return 0;
+}
+
+int pool_init(struct WorkerPool* pool, struct Queue* queue, size_t min_workers, size_t max_workers,
+              void* (*routine)(void*)) {
+  pool->queue = queue;
+  pool->routine = routine;
+  pool->min_workers = min_workers;
+  pool->max_workers = max_workers;
+  pool->num_workers = 0;
+  pool->seen_blocked_us = 0;
+
+  pool->ids = malloc(max_workers * sizeof(int));
+  pool->active = calloc(max_workers, sizeof(int));
+  if (pool->ids == NULL || pool->active == NULL) {
+    free(pool->ids);
+    free(pool->active);
+    return 1;
+  }
+  for (size_t i = 0; i < max_workers; i++) {
+    pool->ids[i] = (int)i;
+  }
+
+  if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+    free(pool->ids);
+    free(pool->active);
+    return 1;
+  }
+
+  if (pthread_mutex_lock(&pool->lock) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return 1;
+  }
+  for (size_t i = 0; i < min_workers; i++) {
+    if (start_worker(pool) != 0) {
+      pthread_mutex_unlock(&pool->lock);
+      return 1;
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return 0;
+}
+
+int pool_adjust(struct WorkerPool* pool) {
+  if (pool->min_workers == pool->max_workers) {
+    return 0;
+  }
+
+  size_t count, waiting;
+  unsigned long blocked_us;
+  if (queue_stats(pool->queue, &count, &waiting, &blocked_us) != 0) {
+    return 1;
+  }
+
+  if (pthread_mutex_lock(&pool->lock) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return 1;
+  }
+
+  int backed_up = count > waiting || blocked_us > pool->seen_blocked_us;
+  pool->seen_blocked_us = blocked_us;
+
+  if (backed_up && pool->num_workers < pool->max_workers && start_worker(pool) != 0) {
+    pthread_mutex_unlock(&pool->lock);
+    return 1;
+  }
+
+  if (pthread_mutex_unlock(&pool->lock) != 0) {
+    fprintf(stderr, "Error unlocking mutex\n");
+    return 1;
+  }
+  return 0;
+}
+
+int pool_wait_item(struct WorkerPool* pool, int worker_id, void** item) {
+  if (pool->min_workers == pool->max_workers) {
+    *item = queue_pop(pool->queue);
+    return *item == NULL ? -1 : 0;
+  }
+
+  while (1) {
+    int ret = queue_pop_timed(pool->queue, item, POOL_IDLE_TIMEOUT_MS);
+    if (ret != 1) {
+      return ret;
+    }
+
+    // Idle for too long, retire unless the pool is at its minimum
+    if (pthread_mutex_lock(&pool->lock) != 0) {
+      fprintf(stderr, "Error locking mutex\n");
+      return -1;
+    }
+
+    int retire = pool->num_workers > pool->min_workers;
+    if (retire) {
+      pool->active[worker_id] = 0;
+      pool->num_workers--;
+    }
+
+    if (pthread_mutex_unlock(&pool->lock) != 0) {
+      fprintf(stderr, "Error unlocking mutex\n");
+      return -1;
+    }
+
+    if (retire) {
+      return 1;
+    }
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef SERVER_POOL_H
+#define SERVER_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "queue.h"
+
+// Pool of worker threads consuming items from a queue. It grows up to max_workers
+// while producers find the queue backed up, and shrinks back to min_workers when
+// workers stay idle.
+struct WorkerPool {
+  struct Queue* queue;          // Queue the workers take items from
+  void* (*routine)(void*);      // Routine run by each worker, given a pointer to its id
+  size_t min_workers;           // Number of workers that are never retired
+  size_t max_workers;           // Maximum number of workers
+  size_t num_workers;           // Number of running workers
+  unsigned long seen_blocked_us;  // Producer blocked time seen on the last adjustment
+  int* ids;                     // Id of each worker slot
+  int* active;                  // Whether each worker slot has a running worker
+  pthread_mutex_t lock;         // Mutex to protect the pool
+};
+
+/// Initializes a pool and starts its minimum number of workers.
+/// @param pool Pool to be initialized.
+/// @param queue Queue the workers take items from.
+/// @param min_workers Number of workers that are never retired.
+/// @param max_workers Maximum number of workers.
+/// @param routine Routine run by each worker, given a pointer to its id.
+/// @return 0 if the pool was initialized successfully, 1 otherwise.
+int pool_init(struct WorkerPool* pool, struct Queue* queue, size_t min_workers, size_t max_workers,
+              void* (*routine)(void*));
+
+/// Starts a new worker if the queue is backed up, i.e. it holds more items than
+/// there are idle workers or a producer was blocked since the last adjustment.
+/// @note Meant to be called by producers after pushing an item.
+/// @param pool Pool to be adjusted.
+/// @return 0 if the pool was adjusted successfully, 1 otherwise.
+int pool_adjust(struct WorkerPool* pool);
+
+/// Waits for the next item for a worker. Workers above the minimum are retired
+/// after being idle for POOL_IDLE_TIMEOUT_MS.
+/// @param pool Pool the worker belongs to.
+/// @param worker_id Id of the worker.
+/// @param item Pointer to the variable to store the item in.
+/// @return 0 if an item was popped, 1 if the worker must exit, -1 on failure.
+int pool_wait_item(struct WorkerPool* pool, int worker_id, void** item);
+
+#endif  // SERVER_POOL_H
@@ -0,0 +1,243 @@
+#define _GNU_SOURCE  // syscall()
+
+#include "queue.h"
+
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define QUEUE_SPIN_COUNT 128  // Attempts on an empty or full queue before going to sleep
+
+/// Sleeps while the given word holds the expected value, at most the given time.
+/// @param word Word to sleep on.
+/// @param expected Value the word held when the queue was found empty or full.
+/// @param timeout Maximum time to sleep, NULL to sleep until woken.
+static void futex_wait(_Atomic uint32_t* word, uint32_t expected, const struct timespec* timeout) {
+  syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0);
+}
+
+/// Wakes one thread sleeping on the given word.
+static void futex_wake(_Atomic uint32_t* word) { syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0); }
+
+/// Gets the time elapsed since the given instant.
+/// @param start Instant measured with CLOCK_MONOTONIC.
+/// @return Elapsed time in microseconds.
+static unsigned long elapsed_us(struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long)((now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000L);
+}
+
+int queue_init(struct Queue* queue, size_t capacity) {
+  if (capacity == 0) {
+    return 1;
+  }
+
+  // With a single slot, a full slot would carry the sequence number a producer of
+  // the next lap expects, so the ring needs at least two
+  if (capacity < 2) {
+    capacity = 2;
+  }
+
+  queue->slots = malloc(capacity * sizeof(struct QueueSlot));
+  if (queue->slots == NULL) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&queue->slots[i].seq, i);
+    queue->slots[i].item = NULL;
+  }
+
+  queue->capacity = capacity;
+  atomic_init(&queue->write_pos, 0);
+  atomic_init(&queue->read_pos, 0);
+  atomic_init(&queue->pushes, 0);
+  atomic_init(&queue->pops, 0);
+  atomic_init(&queue->waiting, 0);
+  atomic_init(&queue->producers_waiting, 0);
+  atomic_init(&queue->blocked_us, 0);
+
+  return 0;
+}
+
+void queue_destroy(struct Queue* queue) { free(queue->slots); }
+
+/// Pushes an item if there is a free slot.
+/// @param queue Queue to be modified.
+/// @param item Item to be pushed.
+/// @return 0 if the item was pushed, 1 if the queue is full.
+static int try_push(struct Queue* queue, void* item) {
+  size_t pos = atomic_load_explicit(&queue->write_pos, memory_order_relaxed);
+
+  while (1) {
+    struct QueueSlot* slot = &queue->slots[pos % queue->capacity];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if (seq == pos) {
+      if (atomic_compare_exchange_weak_explicit(&queue->write_pos, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        // The slot is ours; the release hands the item to the consumer of this lap
+        slot->item = item;
+        atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+        return 0;
+      }
+    } else if (seq < pos) {
+      // The slot still holds the item of the previous lap
+      return 1;
+    } else {
+      pos = atomic_load_explicit(&queue->write_pos, memory_order_relaxed);
+    }
+  }
+}
+
+/// Pops an item if there is one.
+/// @param queue Queue to be modified.
+/// @param item Pointer to the variable to store the item in.
+/// @return 0 if an item was popped, 1 if the queue is empty.
+static int try_pop(struct Queue* queue, void** item) {
+  size_t pos = atomic_load_explicit(&queue->read_pos, memory_order_relaxed);
+
+  while (1) {
+    struct QueueSlot* slot = &queue->slots[pos % queue->capacity];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if (seq == pos + 1) {
+      if (atomic_compare_exchange_weak_explicit(&queue->read_pos, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        // Hand the slot to the producer of the next lap
+        *item = slot->item;
+        atomic_store_explicit(&slot->seq, pos + queue->capacity, memory_order_release);
+        return 0;
+      }
+    } else if (seq < pos + 1) {
+      // The producer of this position has not pushed yet
+      return 1;
+    } else {
+      pos = atomic_load_explicit(&queue->read_pos, memory_order_relaxed);
+    }
+  }
+}
+
+/// Tells the other side that the queue changed, waking one sleeper if there is any.
+/// @param word Word the other side sleeps on.
+/// @param sleepers Number of threads sleeping on the word.
+static void notify(_Atomic uint32_t* word, _Atomic uint32_t* sleepers) {
+  // Either a sleeper sees the new word before sleeping, or this sees the sleeper
+  atomic_fetch_add(word, 1);
+  if (atomic_load(sleepers) != 0) {
+    futex_wake(word);
+  }
+}
+
+int queue_push(struct Queue* queue, void* item) {
+  if (try_push(queue, item) == 0) {
+    notify(&queue->pushes, &queue->waiting);
+    return 0;
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (unsigned int attempt = 0;; attempt++) {
+    if (attempt < QUEUE_SPIN_COUNT) {
+      if (try_push(queue, item) == 0) {
+        break;
+      }
+      continue;
+    }
+
+    // Announce the sleep before the last attempt, so a consumer popping after it wakes us
+    atomic_fetch_add(&queue->producers_waiting, 1);
+    uint32_t pops = atomic_load(&queue->pops);
+    if (try_push(queue, item) == 0) {
+      atomic_fetch_sub(&queue->producers_waiting, 1);
+      break;
+    }
+    futex_wait(&queue->pops, pops, NULL);
+    atomic_fetch_sub(&queue->producers_waiting, 1);
+  }
+
+  atomic_fetch_add_explicit(&queue->blocked_us, elapsed_us(&start), memory_order_relaxed);
+  notify(&queue->pushes, &queue->waiting);
+  return 0;
+}
+
+/// Pops an item, waiting while the queue is empty.
+/// @param queue Queue to be modified.
+/// @param item Pointer to the variable to store the item in.
+/// @param deadline Instant (CLOCK_MONOTONIC) to give up at, NULL to wait forever.
+/// @return 0 if an item was popped, 1 if the deadline passed.
+static int pop_until(struct Queue* queue, void** item, const struct timespec* deadline) {
+  for (unsigned int attempt = 0;; attempt++) {
+    if (try_pop(queue, item) == 0) {
+      break;
+    }
+    if (attempt < QUEUE_SPIN_COUNT) {
+      continue;
+    }
+
+    struct timespec timeout;
+    if (deadline != NULL) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      timeout.tv_sec = deadline->tv_sec - now.tv_sec;
+      timeout.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+      if (timeout.tv_nsec < 0) {
+        timeout.tv_sec--;
+        timeout.tv_nsec += 1000000000L;
+      }
+      if (timeout.tv_sec < 0) {
+        return 1;
+      }
+    }
+
+    // Announce the sleep before the last attempt, so a producer pushing after it wakes us
+    atomic_fetch_add(&queue->waiting, 1);
+    uint32_t pushes = atomic_load(&queue->pushes);
+    if (try_pop(queue, item) == 0) {
+      atomic_fetch_sub(&queue->waiting, 1);
+      break;
+    }
+    futex_wait(&queue->pushes, pushes, deadline != NULL ? &timeout : NULL);
+    atomic_fetch_sub(&queue->waiting, 1);
+  }
+
+  notify(&queue->pops, &queue->producers_waiting);
+  return 0;
+}
+
+void* queue_pop(struct Queue* queue) {
+  void* item;
+  pop_until(queue, &item, NULL);
+  return item;
+}
+
+int queue_pop_timed(struct Queue* queue, void** item, unsigned int timeout_ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  return pop_until(queue, item, &deadline);
+}
+
+int queue_stats(struct Queue* queue, size_t* count, size_t* waiting, unsigned long* blocked_us) {
+  size_t read_pos = atomic_load(&queue->read_pos);
+  size_t write_pos = atomic_load(&queue->write_pos);
+
+  // The positions are read one after the other, so a pop in between may make them cross
+  *count = write_pos > read_pos ? write_pos - read_pos : 0;
+  *waiting = atomic_load(&queue->waiting);
+  *blocked_us = atomic_load_explicit(&queue->blocked_us, memory_order_relaxed);
+
+  return 0;
+}
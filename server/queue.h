@@ -0,0 +1,71 @@
+#ifndef SERVER_QUEUE_H
+#define SERVER_QUEUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define QUEUE_CACHE_LINE 64
+
+// Slot of the queue. Its sequence number tells which lap of the ring may use it:
+// a producer at position pos needs seq == pos, a consumer needs seq == pos + 1.
+struct QueueSlot {
+  _Atomic size_t seq;  // Sequence number of the slot
+  void* item;          // Queued item, valid while the slot is full
+};
+
+// Bounded multi-producer multi-consumer queue. Producers and consumers claim
+// positions with a compare-and-swap and only sleep on a futex when the queue is
+// empty (consumers) or full (producers).
+struct Queue {
+  struct QueueSlot* slots;  // Circular buffer with the queued items
+  size_t capacity;          // Maximum number of items in the queue
+
+  _Alignas(QUEUE_CACHE_LINE) _Atomic size_t write_pos;  // Position of the next item to be pushed
+  _Alignas(QUEUE_CACHE_LINE) _Atomic size_t read_pos;   // Position of the next item to be popped
+
+  _Alignas(QUEUE_CACHE_LINE) _Atomic uint32_t pushes;  // Bumped on every push, consumers sleep on it
+  _Atomic uint32_t pops;                               // Bumped on every pop, producers sleep on it
+  _Atomic uint32_t waiting;                            // Number of consumers waiting for an item
+  _Atomic uint32_t producers_waiting;                  // Number of producers waiting for a free slot
+  _Atomic unsigned long blocked_us;  // Total time producers spent waiting while the queue was full
+};
+
+/// Initializes a queue.
+/// @param queue Queue to be initialized.
+/// @param capacity Maximum number of items in the queue (at least 2 are always allowed).
+/// @return 0 if the queue was initialized successfully, 1 otherwise.
+int queue_init(struct Queue* queue, size_t capacity);
+
+/// Destroys a queue. The items still in it are not freed.
+/// @param queue Queue to be destroyed.
+void queue_destroy(struct Queue* queue);
+
+/// Pushes an item to the queue, waiting while it is full.
+/// @param queue Queue to be modified.
+/// @param item Item to be pushed, not NULL.
+/// @return 0 if the item was pushed successfully, 1 otherwise.
+int queue_push(struct Queue* queue, void* item);
+
+/// Pops an item from the queue, waiting while it is empty.
+/// @param queue Queue to be modified.
+/// @return The item popped, NULL on failure.
+void* queue_pop(struct Queue* queue);
+
+/// Pops an item from the queue, waiting at most the given time while it is empty.
+/// @param queue Queue to be modified.
+/// @param item Pointer to the variable to store the item in.
+/// @param timeout_ms Maximum time to wait, in milliseconds.
+/// @return 0 if an item was popped, 1 if the time ran out, -1 on failure.
+int queue_pop_timed(struct Queue* queue, void** item, unsigned int timeout_ms);
+
+/// Reads the occupancy statistics of the queue.
+/// @note The values are read without stopping the queue, so they are only a recent picture.
+/// @param queue Queue to be inspected.
+/// @param count Pointer to the variable to store the number of items in.
+/// @param waiting Pointer to the variable to store the number of waiting consumers in.
+/// @param blocked_us Pointer to the variable to store the time producers spent blocked in.
+/// @return 0 if the statistics were read successfully, 1 otherwise.
+int queue_stats(struct Queue* queue, size_t* count, size_t* waiting, unsigned long* blocked_us);
+
+#endif  // SERVER_QUEUE_H
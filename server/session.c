@@ -0,0 +1,584 @@
+#include "session.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "common/io.h"
+#include "operations.h"
+#include "parser.h"
+#include "stats.h"
+#include "trace.h"
+
+int session_open(struct Session* session) {
+  switch (session->transport) {
+    case TRANSPORT_FIFO:
+      // abrir response pipe para escrever
+      session->resp_fd = open(session->response_pipe, O_WRONLY);
+      if (session->resp_fd == -1) {
+        fprintf(stderr, "Failed to open pipe\n");
+        return 1;
+      }
+
+      // abrir request pipe para ler
+      session->req_fd = open(session->request_pipe, O_RDONLY);
+      if (session->req_fd == -1) {
+        fprintf(stderr, "Failed to open pipe\n");
+        close(session->resp_fd);
+        return 1;
+      }
+      break;
+
+    case TRANSPORT_SOCKET:
+      // Accepted connections already have their descriptors
+      break;
+
+    case TRANSPORT_SHM:
+      session->shm = shm_segment_open(session->request_pipe, &session->req_fd);
+      if (session->shm == NULL) {
+        fprintf(stderr, "Failed to map shared memory\n");
+        return 1;
+      }
+
+      // The segment descriptor stands in for both rings
+      session->resp_fd = dup(session->req_fd);
+      if (session->resp_fd == -1) {
+        fprintf(stderr, "Failed to attach shared memory\n");
+        shm_segment_close(session->shm);
+        close(session->req_fd);
+        return 1;
+      }
+      break;
+  }
+
+  session->framed = 0;
+  session->frame.data = NULL;
+  session->spare.data = NULL;
+  event_cache_init(&session->events);
+  if (channel_init(&session->channel, session->req_fd, session->resp_fd) != 0) {
+    fprintf(stderr, "Failed to allocate session buffers\n");
+    session_close(session);
+    return 1;
+  }
+  if (session->transport == TRANSPORT_SHM) {
+    channel_attach_rings(&session->channel, &session->shm->request, &session->shm->response);
+  }
+
+  // escrever no response pipe a session_id
+  if(channel_put_int(&session->channel, session->id) != 0 || channel_flush(&session->channel) != 0){
+    fprintf(stderr, "Failed to write to pipe\n");
+    session_close(session);
+    return 1;
+  }
+
+  return 0;
+}
+
+/// Puts the legacy response to a SHOW request in the channel.
+/// @return 0 if the response was buffered successfully, 1 otherwise.
+static int send_show(struct Channel* channel, struct EventCache* events, unsigned int event_id) {
+  size_t rows, cols;
+  unsigned int* seats;
+  int ret = ems_show(events, event_id, &rows, &cols, &seats);
+  if(ret != 0){
+    fprintf(stderr, "Failed to show event\n");
+    stats_fail();
+    return channel_put_int(channel, ret);
+  }
+
+  ret = channel_put_int(channel, 0) != 0 || channel_put_sizet(channel, rows) != 0 ||
+        channel_put_sizet(channel, cols) != 0 || channel_put(channel, seats, rows * cols * sizeof(unsigned int)) != 0;
+  free(seats);
+  return ret;
+}
+
+/// Puts the legacy response to a LIST request in the channel.
+/// @return 0 if the response was buffered successfully, 1 otherwise.
+static int send_list(struct Channel* channel) {
+  size_t num_events;
+  unsigned int* ids;
+  int ret = ems_list_events(&num_events, &ids);
+  if(ret != 0){
+    fprintf(stderr, "Failed to list events\n");
+    stats_fail();
+    return channel_put_int(channel, ret);
+  }
+
+  ret = channel_put_int(channel, 0) != 0 || channel_put_sizet(channel, num_events) != 0 ||
+        channel_put(channel, ids, num_events * sizeof(unsigned int)) != 0;
+  free(ids);
+  return ret;
+}
+
+/// Answers the hello of a client and switches the session to the framed protocol
+/// if the client supports it.
+/// @return 0 if the hello was answered successfully, 1 otherwise.
+static int negotiate(struct Session* session) {
+  unsigned int version;
+  if(channel_get_uint(&session->channel, &version) != 0){
+    fprintf(stderr, "Failed to read from pipe\n");
+    return 1;
+  }
+
+  unsigned int accepted = version >= PROTOCOL_VERSION ? PROTOCOL_VERSION : 0;
+  if(accepted != 0 && session->frame.data == NULL && frame_init(&session->frame) != 0){
+    fprintf(stderr, "Failed to allocate frame\n");
+    accepted = 0;
+  }
+  if(channel_put_uint(&session->channel, accepted) != 0){
+    fprintf(stderr, "Failed to write to pipe\n");
+    return 1;
+  }
+
+  session->framed = accepted != 0;
+  return 0;
+}
+
+/// Computes the size of the fixed-width request at the front of the receive
+/// buffer, as far as the bytes buffered so far tell.
+/// @return The number of bytes the request needs, which may grow once more of
+/// it is buffered.
+static size_t legacy_request_size(const struct Channel* channel) {
+  size_t size = sizeof(char) + sizeof(int);
+  char op_code;
+  if(channel_peek(channel, 0, &op_code, sizeof(char)) != 0){
+    return size;
+  }
+
+  size_t num_seats;
+  switch (op_code) {
+    case '0':
+    case '5':
+      return size + sizeof(unsigned int);
+
+    case '3':
+      return size + sizeof(unsigned int) + 2 * sizeof(size_t);
+
+    case '4':
+      size += sizeof(unsigned int) + sizeof(size_t);
+      // An oversized reservation is rejected by the parser once its header is in
+      if(channel_peek(channel, size - sizeof(size_t), &num_seats, sizeof(size_t)) != 0 ||
+         num_seats > MAX_RESERVATION_SIZE){
+        return size;
+      }
+      return size + 2 * num_seats * sizeof(size_t);
+
+    default:
+      return size;
+  }
+}
+
+/// Receives until a whole fixed-width request is buffered, without waiting on a
+/// non-blocking descriptor.
+/// @return The ReadStatus of the read: READ_OK once the whole request is buffered.
+static enum ReadStatus legacy_request_ready(struct Channel* channel) {
+  size_t size;
+  while ((size = legacy_request_size(channel)) > channel_buffered(channel)) {
+    enum ReadStatus status = channel_fill(channel, size);
+    if (status != READ_OK) {
+      return status;
+    }
+  }
+  return READ_OK;
+}
+
+/// Reads and executes one request of the fixed-width protocol.
+/// @return 0 if the session is still active, 1 if it ended.
+static int handle_legacy_request(struct Session* session) {
+  unsigned int event_id;
+  size_t num_rows, num_columns, num_seats;
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  int ret;
+
+  // ler do request pipe
+  struct Channel* channel = &session->channel;
+  // Nothing is taken until the whole request is buffered, so a request still
+  // arriving is decoded again from its start once the rest comes in
+  switch (legacy_request_ready(channel)) {
+    case READ_OK:
+      break;
+    case READ_AGAIN:
+      return 0;
+    case READ_EOF:
+      // The client closed its end of the session without quitting
+      return 1;
+    case READ_ERROR:
+      fprintf(stderr, "Failed to read from pipe\n");
+      return 1;
+  }
+
+  char op_code;
+  int client_id;
+  if(channel_get(channel, &op_code, sizeof(char)) != 0 || channel_get_int(channel, &client_id) != 0){
+    fprintf(stderr, "Failed to read from pipe\n");
+    return 1;
+  }
+
+  stats_begin(op_code);
+  uint64_t io_start = stats_now();
+
+  switch (op_code) {
+    case '0':
+      return negotiate(session);
+
+    case '2':
+      return 1;
+
+    case '3':
+      if(parse_create(channel, &event_id, &num_rows, &num_columns) != 0){
+        return 1;
+      }
+      stats_add(STATS_PHASE_IO, io_start);
+      trace_create(session->id, event_id, num_rows, num_columns);
+
+      ret = ems_create(&session->events, event_id, num_rows, num_columns);
+      if(channel_put_int(channel, ret) != 0) {
+        fprintf(stderr, "Failed to write to pipe\n");
+        return 1;
+      }
+      if(ret != 0){
+        fprintf(stderr, "Failed to create event\n");
+        stats_fail();
+      }
+      break;
+
+    case '4':
+      if(parse_reserve(channel, &event_id, &num_seats, xs, ys) != 0){
+        return 1;
+      }
+      stats_add(STATS_PHASE_IO, io_start);
+      trace_reserve(session->id, event_id, num_seats, xs, ys);
+
+      ret = ems_reserve(&session->events, event_id, num_seats, xs, ys);
+      if(channel_put_int(channel, ret) != 0) {
+        fprintf(stderr, "Failed to write to pipe\n");
+        return 1;
+      }
+      if(ret != 0){
+        fprintf(stderr, "Failed to reserve seats\n");
+        stats_fail();
+      }
+      break;
+
+    case '5':
+      if(parse_show(channel, &event_id) != 0){
+        return 1;
+      }
+      stats_add(STATS_PHASE_IO, io_start);
+      trace_show(session->id, event_id);
+      if(send_show(channel, &session->events, event_id) != 0){
+        fprintf(stderr, "Failed to write to pipe\n");
+        return 1;
+      }
+      break;
+
+    case '6':
+      trace_request(session->id, op_code);
+      if(send_list(channel) != 0){
+        fprintf(stderr, "Failed to write to pipe\n");
+        return 1;
+      }
+      break;
+  }
+
+  return 0;
+}
+
+// Outcome of a framed request, to be encoded in its response
+struct FrameResult {
+  int ret;               // Status of the request
+  size_t num_rows;       // Rows of the event shown
+  size_t num_columns;    // Columns of the event shown
+  size_t num_values;     // Number of values
+  unsigned int* values;  // Seats shown or ids listed, released once encoded
+};
+
+/// Parses and executes a request of the framed protocol.
+/// @param session Session that sent the request.
+/// @param request Frame holding the request, positioned at its arguments.
+/// @param op_code Opcode of the request.
+/// @param result Outcome of the request, to be encoded with put_result.
+/// @return 0 if the request was executed, 1 if it is malformed.
+static int execute_request(struct Session* session, struct Frame* request, char op_code, struct FrameResult* result) {
+  unsigned int event_id;
+  size_t num_rows, num_columns, num_seats, num_events;
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  struct EventSeats parts[MAX_TRANSACTION_EVENTS];
+
+  result->values = NULL;
+  switch (op_code) {
+    case '3':
+      if(parse_frame_create(request, &event_id, &num_rows, &num_columns) != 0){
+        return 1;
+      }
+      trace_create(session->id, event_id, num_rows, num_columns);
+      result->ret = ems_create(&session->events, event_id, num_rows, num_columns);
+      if(result->ret != 0){
+        fprintf(stderr, "Failed to create event\n");
+        stats_fail();
+      }
+      break;
+
+    case '4':
+      if(parse_frame_reserve(request, &event_id, &num_seats, xs, ys) != 0){
+        return 1;
+      }
+      trace_reserve(session->id, event_id, num_seats, xs, ys);
+      result->ret = ems_reserve(&session->events, event_id, num_seats, xs, ys);
+      if(result->ret != 0){
+        fprintf(stderr, "Failed to reserve seats\n");
+        stats_fail();
+      }
+      break;
+
+    case 'M':
+      if(parse_frame_reserve_all(request, &num_events, parts, xs, ys) != 0){
+        return 1;
+      }
+      trace_reserve_all(session->id, num_events, parts);
+      result->ret = ems_reserve_all(&session->events, num_events, parts);
+      if(result->ret != 0){
+        fprintf(stderr, "Failed to reserve seats\n");
+        stats_fail();
+      }
+      break;
+
+    case '5':
+      if(parse_frame_show(request, &event_id) != 0){
+        return 1;
+      }
+      trace_show(session->id, event_id);
+      result->ret = ems_show(&session->events, event_id, &result->num_rows, &result->num_columns, &result->values);
+      if(result->ret != 0){
+        fprintf(stderr, "Failed to show event\n");
+        stats_fail();
+      }
+      break;
+
+    case '6':
+      trace_request(session->id, op_code);
+      result->ret = ems_list_events(&result->num_values, &result->values);
+      if(result->ret != 0){
+        fprintf(stderr, "Failed to list events\n");
+        stats_fail();
+      }
+      break;
+
+    case '9':
+      trace_request(session->id, op_code);
+      result->ret = 0;
+      break;
+
+    default:
+      fprintf(stderr, "Invalid request\n");
+      return 1;
+  }
+  return 0;
+}
+
+/// Encodes the status and payload of an executed request, releasing its values.
+/// @param response Frame to append the result to.
+/// @param op_code Opcode of the request.
+/// @param result Outcome of the request.
+/// @return 0 if the result was encoded, 1 if it does not fit.
+static int put_result(struct Frame* response, char op_code, struct FrameResult* result) {
+  if(frame_put_varint(response, (uint64_t)result->ret) != 0){
+    free(result->values);
+    return 1;
+  }
+  if(result->ret != 0){
+    return 0;
+  }
+
+  int failed = 0;
+  if(op_code == '5'){
+    size_t num_seats = result->num_rows * result->num_columns;
+    failed = frame_put_varint(response, result->num_rows) != 0 || frame_put_varint(response, result->num_columns) != 0;
+    for(size_t i = 0; !failed && i < num_seats; i++){
+      failed = frame_put_varint(response, result->values[i]) != 0;
+    }
+  }
+  else if(op_code == '6'){
+    // Ids are listed in creation order, which is usually ascending, so deltas stay short
+    failed = frame_put_varint(response, result->num_values) != 0;
+    int64_t previous = 0;
+    for(size_t i = 0; !failed && i < result->num_values; i++){
+      failed = frame_put_svarint(response, (int64_t)result->values[i] - previous) != 0;
+      previous = result->values[i];
+    }
+  }
+  else if(op_code == '9'){
+    // The latency table is followed by the lock table, each of which fits STATS_REPORT_SIZE
+    char report[2 * STATS_REPORT_SIZE];
+    size_t len = stats_format(report, STATS_REPORT_SIZE);
+    len += ems_lock_report(report + len, sizeof(report) - len);
+    failed = frame_put_bytes(response, report, len) != 0;
+  }
+  free(result->values);
+  return failed;
+}
+
+/// Executes the CREATE, RESERVE, SHOW, LIST and RESERVE_ALL requests of a batch in
+/// order and encodes their results back to back, each as a single request would have it.
+/// @note The results are encoded in the spare frame of the session, which is then
+/// swapped with the one that held the batch.
+/// @param session Session whose frame holds the batch.
+/// @return 0 if the response was encoded, 1 if the batch is malformed or the response does not fit.
+static int execute_batch(struct Session* session) {
+  struct Frame* request = &session->frame;
+  struct Frame* response = &session->spare;
+  if(response->data == NULL && frame_init(response) != 0){
+    fprintf(stderr, "Failed to allocate frame\n");
+    return 1;
+  }
+
+  // The batch itself always succeeds; each request has its own status
+  frame_reset(response, 'B', 0);
+  if(frame_put_varint(response, 0) != 0){
+    return 1;
+  }
+
+  for(size_t count = 0; request->pos < request->len; count++){
+    uint64_t op_code;
+    if(count == MAX_BATCH_SIZE || frame_get_varint(request, &op_code) != 0 ||
+       ((op_code < '3' || op_code > '6') && op_code != 'M')){
+      fprintf(stderr, "Malformed batch request\n");
+      return 1;
+    }
+
+    stats_begin((char)op_code);
+    struct FrameResult result;
+    int failed = execute_request(session, request, (char)op_code, &result) != 0 ||
+                 put_result(response, (char)op_code, &result) != 0;
+    stats_end();
+    if(failed){
+      return 1;
+    }
+  }
+
+  struct Frame batch = session->frame;
+  session->frame = session->spare;
+  session->spare = batch;
+  return 0;
+}
+
+/// Executes a framed request and encodes its response into the same frame.
+/// @param session Session whose frame holds the request.
+/// @param op_code Opcode of the request.
+/// @return 0 if the response was encoded, 1 if the request is malformed or the response does not fit.
+static int execute_frame(struct Session* session, char op_code) {
+  struct Frame* frame = &session->frame;
+  if(op_code == 'B'){
+    return execute_batch(session);
+  }
+
+  struct FrameResult result;
+  if(execute_request(session, frame, op_code, &result) != 0){
+    return 1;
+  }
+
+  // The response reuses the opcode of the request
+  frame_reset(frame, op_code, 0);
+  return put_result(frame, op_code, &result);
+}
+
+/// Reads and executes one request of the framed protocol.
+/// @return 0 if the session is still active, 1 if it ended.
+static int handle_frame_request(struct Session* session) {
+  struct Frame* frame = &session->frame;
+
+  uint64_t read_start = stats_now();
+  switch (channel_get_frame(&session->channel, frame, MAX_REQUEST_BODY_SIZE)) {
+    case READ_OK:
+      break;
+    case READ_AGAIN:
+      return 0;
+    case READ_EOF:
+      // The client closed its end of the session without quitting
+      return 1;
+    case READ_ERROR:
+      fprintf(stderr, "Failed to read from pipe\n");
+      return 1;
+  }
+
+  if(frame->op_code == '2'){
+    return 1;
+  }
+
+  // No flags are defined yet
+  if(frame->flags != 0){
+    fprintf(stderr, "Malformed request\n");
+    return 1;
+  }
+
+  // A batch is measured as a whole too, so its reads and writes are not lost
+  // among the requests it carries
+  stats_begin_at(frame->op_code, read_start);
+  stats_add(STATS_PHASE_IO, read_start);
+  if(execute_frame(session, frame->op_code) != 0){
+    return 1;
+  }
+
+  uint64_t io_start = stats_now();
+  if(channel_put_frame(&session->channel, frame) != 0){
+    fprintf(stderr, "Failed to write to pipe\n");
+    return 1;
+  }
+  stats_add(STATS_PHASE_IO, io_start);
+  return 0;
+}
+
+int session_has_buffered(struct Session* session) {
+  // A request that is still arriving must wait for the descriptor instead
+  struct Channel* channel = &session->channel;
+  if (session->framed) {
+    return channel_has_frame(channel);
+  }
+  return channel_buffered(channel) > 0 && channel_buffered(channel) >= legacy_request_size(channel);
+}
+
+int session_handle_request(struct Session* session) {
+  int ended = session->framed ? handle_frame_request(session) : handle_legacy_request(session);
+  if (ended) {
+    // Recorded however the session ended, as a later session may reuse its id
+    trace_request(session->id, '2');
+  }
+
+  // Responses go out in one write once no further request is waiting whole in the
+  // buffer, so a burst of pipelined requests is answered with a single write
+  uint64_t io_start = stats_now();
+  if((ended || !session_has_buffered(session)) && channel_flush(&session->channel) != 0){
+    fprintf(stderr, "Failed to write to pipe\n");
+    stats_end();
+    return 1;
+  }
+  stats_add(STATS_PHASE_IO, io_start);
+  stats_end();
+  return ended;
+}
+
+int session_close(struct Session* session) {
+  frame_free(&session->frame);
+  frame_free(&session->spare);
+  channel_free(&session->channel);
+
+  if (session->transport == TRANSPORT_SHM) {
+    shm_segment_close(session->shm);
+  }
+
+  if(close(session->req_fd) != 0){
+    fprintf(stderr, "Failed to close pipe\n");
+    return 1;
+  }
+  if(close(session->resp_fd) != 0){
+    fprintf(stderr, "Failed to close pipe\n");
+    return 1;
+  }
+  if (session->transport == TRANSPORT_FIFO) {
+    unlink(session->response_pipe);
+    unlink(session->request_pipe);
+  }
+  return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef SERVER_SESSION_H
+#define SERVER_SESSION_H
+
+#include "common/constants.h"
+#include "common/io.h"
+#include "common/ring.h"
+#include "operations.h"
+
+enum SessionTransport {
+  TRANSPORT_FIFO,    // Pair of named pipes registered through the server FIFO
+  TRANSPORT_SOCKET,  // Connection accepted on the Unix socket, used in both directions
+  TRANSPORT_SHM,     // Shared-memory rings registered through the server FIFO
+};
+
+// Client session
+struct Session {
+  int id;                              // Session id sent to the client
+  enum SessionTransport transport;     // How the client reaches the session
+  char request_pipe[PIPE_NAME_SIZE];   // Path of the pipe the client writes requests to, or segment name
+  char response_pipe[PIPE_NAME_SIZE];  // Path of the pipe the client reads responses from
+  int req_fd;                          // Request pipe, opened for reading
+  int resp_fd;                         // Response pipe, opened for writing
+  struct ShmSegment* shm;              // Shared-memory segment, for TRANSPORT_SHM
+  int registered;                      // Whether the session is open and in the epoll set, in event-loop mode
+  int framed;                          // Whether the client negotiated the framed protocol
+  struct Frame frame;                  // Buffer for the requests and responses of a framed session
+  struct Frame spare;                  // Buffer the response to a batch is built in
+  struct Channel channel;              // Buffered requests and responses over req_fd and resp_fd
+  struct EventCache events;            // Events the session already resolved
+};
+
+/// Opens the pipes or segment of a session, unless it already has descriptors,
+/// and sends the session id to the client.
+/// @param session Session whose transport, pipe paths or descriptors and id are set.
+/// @return 0 if the session was opened successfully, 1 otherwise.
+int session_open(struct Session* session);
+
+/// Reads one request from the session and executes it.
+/// @note If the request pipe is non-blocking and has no whole request, nothing is
+/// done and the bytes that did arrive are kept for the next call.
+/// A client that opens with a hello ('0') and a supported version switches the
+/// session to the framed protocol; other clients keep the fixed-width one.
+/// @param session Session to serve.
+/// @return 0 if the session is still active, 1 if it ended.
+int session_handle_request(struct Session* session);
+
+/// Checks whether a whole request was read ahead and is waiting in the receive buffer.
+/// @note The request pipe does not become readable again for buffered requests, but
+/// it does for the rest of a request that has only partly arrived.
+/// @param session Session to check.
+/// @return Non-zero if there are buffered bytes, 0 otherwise.
+int session_has_buffered(struct Session* session);
+
+/// Closes the descriptors of a session and unlinks its pipes or unmaps its segment.
+/// @param session Session to close.
+/// @return 0 if the pipes were closed successfully, 1 otherwise.
+int session_close(struct Session* session);
+
+#endif  // SERVER_SESSION_H
@@ -0,0 +1,356 @@
+#include "stats.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STATS_SUB_BUCKETS (1u << STATS_SUB_BUCKET_BITS)
+
+// Histograms and counters of one thread. Only the owning thread writes them, so
+// updates are plain loads and stores; readers merging them may see a slightly
+// stale value but never a torn one. Records are reused by later threads once
+// their thread exits, and are never freed.
+struct StatsRecord {
+  _Atomic uint64_t buckets[STATS_OP_COUNT][STATS_PHASE_COUNT][STATS_BUCKET_COUNT];  // Requests per latency
+  _Atomic uint64_t total_ns[STATS_OP_COUNT][STATS_PHASE_COUNT];  // Sum of the latencies
+  _Atomic uint64_t failures[STATS_OP_COUNT];                      // Requests that failed
+  atomic_int in_use;                                               // Whether a thread owns the record
+  struct StatsRecord *next;                                        // Next record, immutable once published
+};
+
+// Request being measured by a thread
+struct StatsRequest {
+  int op;                                // StatsOp of the request, -1 if none
+  int failed;                            // Whether the request failed
+  uint64_t start;                        // Instant the request started
+  uint64_t phase_ns[STATS_PHASE_COUNT];  // Time spent in each phase so far
+};
+
+static uint64_t start_time = 0;
+static _Atomic(struct StatsRecord *) records = NULL;
+static pthread_mutex_t records_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t record_key;
+static pthread_once_t record_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local struct StatsRecord *local_record = NULL;
+static _Thread_local struct StatsRequest current = {.op = -1};
+static _Thread_local struct StatsRequest outer = {.op = -1};  // Batch the current request is nested in
+
+static const char *op_names[STATS_OP_COUNT] = {"CREATE", "RESERVE", "SHOW", "LIST", "RES_ALL", "BATCH"};
+static const char *phase_names[STATS_PHASE_COUNT] = {"total", "state", "lock", "io"};
+
+/// Releases the record of an exiting thread for reuse, keeping its counts.
+static void release_record(void *arg) {
+  struct StatsRecord *record = arg;
+  atomic_store(&record->in_use, 0);
+}
+
+static void create_record_key(void) {
+  if (pthread_key_create(&record_key, release_record) != 0) {
+    fprintf(stderr, "Failed to create stats record key\n");
+  }
+}
+
+/// Gives the calling thread a record, reusing one released by an exited thread if possible.
+/// @return The record of the thread, NULL on failure.
+static struct StatsRecord *register_thread(void) {
+  pthread_once(&record_key_once, create_record_key);
+
+  pthread_mutex_lock(&records_lock);
+
+  struct StatsRecord *record = atomic_load(&records);
+  while (record != NULL && atomic_load(&record->in_use)) {
+    record = record->next;
+  }
+
+  if (record == NULL) {
+    record = calloc(1, sizeof(struct StatsRecord));
+    if (record == NULL) {
+      pthread_mutex_unlock(&records_lock);
+      return NULL;
+    }
+    record->next = atomic_load(&records);
+    atomic_store(&records, record);
+  }
+  atomic_store(&record->in_use, 1);
+
+  pthread_mutex_unlock(&records_lock);
+
+  pthread_setspecific(record_key, record);
+  local_record = record;
+  return record;
+}
+
+/// Adds to a counter owned by the calling thread.
+static void bump(_Atomic uint64_t *counter, uint64_t value) {
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+/// Maps a latency to its bucket: exact below 16 ns, then 16 buckets per power of two.
+/// @param ns Latency in nanoseconds.
+/// @return Index of the bucket.
+static size_t bucket_of(uint64_t ns) {
+  if (ns < STATS_SUB_BUCKETS) {
+    return (size_t)ns;
+  }
+
+  unsigned int magnitude = 63u - (unsigned int)__builtin_clzll(ns);
+  if (magnitude > STATS_MAX_MAGNITUDE) {
+    return STATS_BUCKET_COUNT - 1;
+  }
+
+  unsigned int shift = magnitude - STATS_SUB_BUCKET_BITS;
+  return ((size_t)(shift + 1) << STATS_SUB_BUCKET_BITS) + (size_t)((ns >> shift) & (STATS_SUB_BUCKETS - 1));
+}
+
+/// Gets the largest latency that falls in a bucket.
+/// @param bucket Index of the bucket.
+/// @return Latency in nanoseconds.
+static uint64_t bucket_limit(size_t bucket) {
+  if (bucket < STATS_SUB_BUCKETS) {
+    return bucket;
+  }
+
+  unsigned int shift = (unsigned int)(bucket >> STATS_SUB_BUCKET_BITS) - 1;
+  uint64_t lowest = (uint64_t)(STATS_SUB_BUCKETS + (bucket & (STATS_SUB_BUCKETS - 1))) << shift;
+  return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+void stats_init(void) { start_time = stats_now(); }
+
+uint64_t stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void stats_begin(char op_code) { stats_begin_at(op_code, stats_now()); }
+
+void stats_begin_at(char op_code, uint64_t start) {
+  if (current.op == STATS_OP_BATCH) {
+    outer = current;
+  }
+
+  switch (op_code) {
+    case '3':
+      current.op = STATS_OP_CREATE;
+      break;
+    case '4':
+      current.op = STATS_OP_RESERVE;
+      break;
+    case '5':
+      current.op = STATS_OP_SHOW;
+      break;
+    case '6':
+      current.op = STATS_OP_LIST;
+      break;
+    case 'M':
+      current.op = STATS_OP_RESERVE_ALL;
+      break;
+    case 'B':
+      current.op = STATS_OP_BATCH;
+      break;
+    default:
+      current.op = -1;
+      return;
+  }
+
+  current.failed = 0;
+  memset(current.phase_ns, 0, sizeof(current.phase_ns));
+  current.start = start;
+}
+
+void stats_add(enum StatsPhase phase, uint64_t start) {
+  if (current.op >= 0) {
+    current.phase_ns[phase] += stats_now() - start;
+  }
+}
+
+void stats_fail(void) { current.failed = 1; }
+
+/// Records the request being measured in the histograms of the calling thread.
+static void record_current(void) {
+  size_t op = (size_t)current.op;
+  current.phase_ns[STATS_PHASE_TOTAL] = stats_now() - current.start;
+
+  struct StatsRecord *record = local_record;
+  if (record == NULL && (record = register_thread()) == NULL) {
+    return;
+  }
+
+  for (size_t phase = 0; phase < STATS_PHASE_COUNT; phase++) {
+    bump(&record->buckets[op][phase][bucket_of(current.phase_ns[phase])], 1);
+    bump(&record->total_ns[op][phase], current.phase_ns[phase]);
+  }
+  if (current.failed) {
+    bump(&record->failures[op], 1);
+  }
+}
+
+void stats_end(void) {
+  if (current.op >= 0) {
+    record_current();
+  }
+  current.op = -1;
+
+  // Go back to the batch the request was part of
+  if (outer.op >= 0) {
+    current = outer;
+    outer.op = -1;
+  }
+}
+
+/// Finds the latency below which the given fraction of a histogram falls.
+/// @param buckets Merged histogram.
+/// @param count Number of requests in the histogram.
+/// @param fraction Fraction of the requests, in thousandths.
+/// @return Latency in nanoseconds.
+static uint64_t percentile(const uint64_t *buckets, uint64_t count, uint64_t fraction) {
+  uint64_t rank = (count * fraction + 999) / 1000;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < STATS_BUCKET_COUNT; i++) {
+    seen += buckets[i];
+    if (seen >= rank && seen > 0) {
+      return bucket_limit(i);
+    }
+  }
+  return 0;
+}
+
+size_t stats_format(char *buf, size_t size) {
+  static uint64_t merged[STATS_PHASE_COUNT][STATS_BUCKET_COUNT];
+  static pthread_mutex_t merge_lock = PTHREAD_MUTEX_INITIALIZER;
+
+  pthread_mutex_lock(&merge_lock);
+
+  double uptime_s = (double)(stats_now() - start_time) / 1e9;
+  size_t len = 0;
+  int written = snprintf(buf, size, "uptime %.1f s\n%-8s %10s %8s %9s %6s %10s %10s %10s %10s %10s\n",
+                         uptime_s, "op", "requests", "failed", "per_s", "phase", "mean_us", "p50_us", "p90_us",
+                         "p99_us", "max_us");
+  len += written > 0 ? (size_t)written : 0;
+
+  for (size_t op = 0; op < STATS_OP_COUNT; op++) {
+    uint64_t totals[STATS_PHASE_COUNT] = {0};
+    uint64_t failures = 0;
+    memset(merged, 0, sizeof(merged));
+
+    for (struct StatsRecord *record = atomic_load(&records); record != NULL; record = record->next) {
+      for (size_t phase = 0; phase < STATS_PHASE_COUNT; phase++) {
+        for (size_t i = 0; i < STATS_BUCKET_COUNT; i++) {
+          merged[phase][i] += atomic_load_explicit(&record->buckets[op][phase][i], memory_order_relaxed);
+        }
+        totals[phase] += atomic_load_explicit(&record->total_ns[op][phase], memory_order_relaxed);
+      }
+      failures += atomic_load_explicit(&record->failures[op], memory_order_relaxed);
+    }
+
+    uint64_t count = 0;
+    for (size_t i = 0; i < STATS_BUCKET_COUNT; i++) {
+      count += merged[STATS_PHASE_TOTAL][i];
+    }
+
+    for (size_t phase = 0; phase < STATS_PHASE_COUNT && len < size; phase++) {
+      double mean_us = count > 0 ? (double)totals[phase] / (double)count / 1e3 : 0.0;
+      if (phase == STATS_PHASE_TOTAL) {
+        written = snprintf(buf + len, size - len, "%-8s %10llu %8llu %9.1f ", op_names[op], (unsigned long long)count,
+                           (unsigned long long)failures, uptime_s > 0 ? (double)count / uptime_s : 0.0);
+      } else {
+        written = snprintf(buf + len, size - len, "%-8s %10s %8s %9s ", "", "", "", "");
+      }
+      len += written > 0 ? (size_t)written : 0;
+      if (len >= size) {
+        break;
+      }
+
+      written = snprintf(buf + len, size - len, "%6s %10.1f %10.1f %10.1f %10.1f %10.1f\n", phase_names[phase],
+                         mean_us, (double)percentile(merged[phase], count, 500) / 1e3,
+                         (double)percentile(merged[phase], count, 900) / 1e3,
+                         (double)percentile(merged[phase], count, 990) / 1e3,
+                         (double)percentile(merged[phase], count, 1000) / 1e3);
+      len += written > 0 ? (size_t)written : 0;
+    }
+  }
+
+  pthread_mutex_unlock(&merge_lock);
+
+  return len < size ? len : size - 1;
+}
+
+// File the reports are dumped to, and how often
+struct DumpTarget {
+  char *path;               // Path of the file
+  unsigned int interval_s;  // Seconds between reports
+};
+
+/// Replaces the report file every interval, writing to a temporary file first so
+/// readers never see a partial report.
+/// @param arg DumpTarget of the reports.
+static void *dump_reports(void *arg) {
+  struct DumpTarget *target = arg;
+  char report[STATS_REPORT_SIZE];
+
+  size_t path_len = strlen(target->path);
+  char *temp_path = malloc(path_len + 5);
+  if (temp_path == NULL) {
+    fprintf(stderr, "Failed to allocate stats path\n");
+    return NULL;
+  }
+  memcpy(temp_path, target->path, path_len);
+  memcpy(temp_path + path_len, ".tmp", 5);
+
+  while (1) {
+    struct timespec interval = {(time_t)target->interval_s, 0};
+    while (nanosleep(&interval, &interval) != 0) {
+    }
+
+    size_t len = stats_format(report, sizeof(report));
+    FILE *file = fopen(temp_path, "w");
+    if (file == NULL) {
+      fprintf(stderr, "Failed to open stats file\n");
+      continue;
+    }
+    int failed = fwrite(report, 1, len, file) != len;
+    failed |= fclose(file) != 0;
+    if (failed || rename(temp_path, target->path) != 0) {
+      fprintf(stderr, "Failed to write stats file\n");
+    }
+  }
+}
+
+int stats_start_dump(const char *path, unsigned int interval_s) {
+  struct DumpTarget *target = malloc(sizeof(struct DumpTarget));
+  if (target == NULL) {
+    return 1;
+  }
+  target->interval_s = interval_s > 0 ? interval_s : 1;
+  target->path = malloc(strlen(path) + 1);
+  if (target->path == NULL) {
+    free(target);
+    return 1;
+  }
+  strcpy(target->path, path);
+
+  // The thread inherits a fully blocked mask, so signals keep going to the threads that handle them
+  sigset_t all, previous;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &previous);
+
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, &dump_reports, target);
+
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+  if (ret != 0) {
+    fprintf(stderr, "Error creating stats thread\n");
+    free(target->path);
+    free(target);
+    return 1;
+  }
+  pthread_detach(thread);
+  return 0;
+}
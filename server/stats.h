@@ -0,0 +1,75 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATS_SUB_BUCKET_BITS 4  // Each power of two is split in 16 buckets, about 6% apart
+#define STATS_MAX_MAGNITUDE 42   // Latencies from 2^42 ns (over an hour) on share the last bucket
+#define STATS_BUCKET_COUNT ((STATS_MAX_MAGNITUDE - STATS_SUB_BUCKET_BITS + 2) << STATS_SUB_BUCKET_BITS)
+#define STATS_REPORT_SIZE 4096   // Room for a whole report
+
+// Requests that are measured
+enum StatsOp {
+  STATS_OP_CREATE,
+  STATS_OP_RESERVE,
+  STATS_OP_SHOW,
+  STATS_OP_LIST,
+  STATS_OP_RESERVE_ALL,
+  STATS_OP_BATCH,  // A batch as a whole, reading it and writing its response; its requests have their own rows
+  STATS_OP_COUNT
+};
+
+// Parts of a request that are measured. The total also covers time spent outside the others.
+enum StatsPhase {
+  STATS_PHASE_TOTAL,  // From the opcode being read to the response being written
+  STATS_PHASE_STATE,  // Simulated accesses to the state
+  STATS_PHASE_LOCK,   // Waiting for the locks of the list and the events
+  STATS_PHASE_IO,     // Reading the arguments and writing the response
+  STATS_PHASE_COUNT
+};
+
+/// Records the instant the server started, from which throughput is measured.
+void stats_init(void);
+
+/// Gets the current instant.
+/// @return Nanoseconds on CLOCK_MONOTONIC.
+uint64_t stats_now(void);
+
+/// Starts measuring a request in the calling thread.
+/// @note A request begun while a batch is measured is nested in it: ending the
+/// request resumes measuring the batch.
+/// @param op_code Opcode of the request. Requests that are not measured are ignored.
+void stats_begin(char op_code);
+
+/// Starts measuring a request in the calling thread, counting from an earlier instant.
+/// @param op_code Opcode of the request. Requests that are not measured are ignored.
+/// @param start Instant the request started, from stats_now.
+void stats_begin_at(char op_code, uint64_t start);
+
+/// Adds the time elapsed since the given instant to a phase of the request being measured.
+/// @note Does nothing when the calling thread is not measuring a request.
+/// @param phase Phase the time was spent in.
+/// @param start Instant the phase started, from stats_now.
+void stats_add(enum StatsPhase phase, uint64_t start);
+
+/// Marks the request being measured as failed.
+void stats_fail(void);
+
+/// Finishes measuring the request of the calling thread and records it.
+/// @note The histograms are owned by the thread, so recording takes no lock and no atomic read-modify-write.
+void stats_end(void);
+
+/// Merges the histograms of every thread and formats them as a table.
+/// @param buf Buffer to write the report to.
+/// @param size Size of the buffer, STATS_REPORT_SIZE is always enough.
+/// @return Length of the report, without the null terminator.
+size_t stats_format(char *buf, size_t size);
+
+/// Starts a thread that periodically replaces the given file by a fresh report.
+/// @param path Path of the file.
+/// @param interval_s Seconds between reports.
+/// @return 0 if the thread was started successfully, 1 otherwise.
+int stats_start_dump(const char *path, unsigned int interval_s);
+
+#endif  // SERVER_STATS_H
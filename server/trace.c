@@ -0,0 +1,206 @@
+#include "trace.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "common/io.h"
+#include "operations.h"
+#include "stats.h"
+
+static atomic_int tracing = 0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct Channel trace_channel;  // Records not written yet, sent to the trace file
+static struct Frame trace_frame;      // Record being encoded
+static uint64_t last_record_ns;       // Instant of the previous record
+
+/// Stops recording after the trace file failed. Called with trace_lock held.
+static void fail_trace(void) {
+  fprintf(stderr, "Failed to write trace, recording stopped\n");
+  atomic_store(&tracing, 0);
+  close(trace_channel.out_fd);
+  channel_free(&trace_channel);
+  frame_free(&trace_frame);
+}
+
+/// Starts a record of the given request, taking trace_lock.
+/// @return 0 if the record was started, with the lock held; 1 if recording is off.
+static int begin_record(int session_id, char op_code) {
+  if (!atomic_load_explicit(&tracing, memory_order_relaxed)) {
+    return 1;
+  }
+
+  pthread_mutex_lock(&trace_lock);
+  if (!atomic_load_explicit(&tracing, memory_order_relaxed)) {
+    pthread_mutex_unlock(&trace_lock);
+    return 1;
+  }
+
+  // Taking the instant under the lock keeps the records in timestamp order
+  uint64_t now = stats_now();
+  frame_reset(&trace_frame, op_code, 0);
+  if (frame_put_varint(&trace_frame, now - last_record_ns) != 0 ||
+      frame_put_varint(&trace_frame, (uint64_t)session_id) != 0) {
+    fail_trace();
+    pthread_mutex_unlock(&trace_lock);
+    return 1;
+  }
+  last_record_ns = now;
+  return 0;
+}
+
+/// Buffers the record being encoded and releases trace_lock.
+/// @param failed Whether encoding the arguments failed.
+static void end_record(int failed) {
+  if (failed || channel_put_frame(&trace_channel, &trace_frame) != 0) {
+    fail_trace();
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+/// Writes the buffered records every TRACE_FLUSH_INTERVAL_MS until recording stops.
+static void *flush_trace(void *arg) {
+  (void)arg;
+  while (1) {
+    struct timespec interval = {TRACE_FLUSH_INTERVAL_MS / 1000, (TRACE_FLUSH_INTERVAL_MS % 1000) * 1000000};
+    while (nanosleep(&interval, &interval) != 0) {
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    if (!atomic_load(&tracing)) {
+      pthread_mutex_unlock(&trace_lock);
+      return NULL;
+    }
+    if (channel_flush(&trace_channel) != 0) {
+      fail_trace();
+    }
+    pthread_mutex_unlock(&trace_lock);
+  }
+}
+
+int trace_open(const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+  if (fd == -1) {
+    fprintf(stderr, "Failed to open trace file\n");
+    return 1;
+  }
+  if (channel_init(&trace_channel, -1, fd) != 0 || frame_init(&trace_frame) != 0) {
+    fprintf(stderr, "Failed to allocate trace buffers\n");
+    channel_free(&trace_channel);
+    close(fd);
+    return 1;
+  }
+
+  last_record_ns = stats_now();
+  frame_reset(&trace_frame, TRACE_OP_HEADER, 0);
+  if (frame_put_varint(&trace_frame, TRACE_VERSION) != 0 || write_frame(fd, &trace_frame) != 0) {
+    fprintf(stderr, "Failed to write trace file\n");
+    channel_free(&trace_channel);
+    frame_free(&trace_frame);
+    close(fd);
+    return 1;
+  }
+  atomic_store(&tracing, 1);
+
+  // The thread inherits a fully blocked mask, so signals keep going to the threads that handle them
+  sigset_t all, previous;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &previous);
+
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, &flush_trace, NULL);
+
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+  if (ret != 0) {
+    fprintf(stderr, "Error creating trace thread\n");
+    pthread_mutex_lock(&trace_lock);
+    atomic_store(&tracing, 0);
+    close(fd);
+    channel_free(&trace_channel);
+    frame_free(&trace_frame);
+    pthread_mutex_unlock(&trace_lock);
+    return 1;
+  }
+  pthread_detach(thread);
+  return 0;
+}
+
+void trace_close(void) {
+  pthread_mutex_lock(&trace_lock);
+  if (atomic_load(&tracing)) {
+    atomic_store(&tracing, 0);
+    if (channel_flush(&trace_channel) != 0) {
+      fprintf(stderr, "Failed to write trace\n");
+    }
+    close(trace_channel.out_fd);
+    channel_free(&trace_channel);
+    frame_free(&trace_frame);
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_request(int session_id, char op_code) {
+  if (begin_record(session_id, op_code) != 0) {
+    return;
+  }
+
+  // Sessions end rarely, and writing then keeps every ended session whole in the file
+  int failed = channel_put_frame(&trace_channel, &trace_frame) != 0;
+  if (!failed && op_code == '2') {
+    failed = channel_flush(&trace_channel) != 0;
+  }
+  if (failed) {
+    fail_trace();
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_create(int session_id, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (begin_record(session_id, '3') != 0) {
+    return;
+  }
+  end_record(frame_put_varint(&trace_frame, event_id) != 0 || frame_put_varint(&trace_frame, num_rows) != 0 ||
+             frame_put_varint(&trace_frame, num_cols) != 0);
+}
+
+/// Encodes the arguments of a RESERVE request into the record being encoded.
+/// @return 0 if the arguments were encoded, 1 if they do not fit.
+static int put_reserve_args(unsigned int event_id, size_t num_seats, const size_t *xs, const size_t *ys) {
+  int failed = frame_put_varint(&trace_frame, event_id) != 0 || frame_put_varint(&trace_frame, num_seats) != 0;
+  for (size_t i = 0; !failed && i < num_seats; i++) {
+    failed = frame_put_varint(&trace_frame, xs[i]) != 0 || frame_put_varint(&trace_frame, ys[i]) != 0;
+  }
+  return failed;
+}
+
+void trace_reserve(int session_id, unsigned int event_id, size_t num_seats, const size_t *xs, const size_t *ys) {
+  if (begin_record(session_id, '4') != 0) {
+    return;
+  }
+  end_record(put_reserve_args(event_id, num_seats, xs, ys));
+}
+
+void trace_reserve_all(int session_id, size_t num_events, const struct EventSeats *parts) {
+  if (begin_record(session_id, 'M') != 0) {
+    return;
+  }
+  int failed = frame_put_varint(&trace_frame, num_events) != 0;
+  for (size_t i = 0; !failed && i < num_events; i++) {
+    failed = put_reserve_args(parts[i].event_id, parts[i].num_seats, parts[i].xs, parts[i].ys);
+  }
+  end_record(failed);
+}
+
+void trace_show(int session_id, unsigned int event_id) {
+  if (begin_record(session_id, '5') != 0) {
+    return;
+  }
+  end_record(frame_put_varint(&trace_frame, event_id) != 0);
+}
@@ -0,0 +1,67 @@
+#ifndef SERVER_TRACE_H
+#define SERVER_TRACE_H
+
+#include <stddef.h>
+
+#define TRACE_VERSION 1      // Version of the trace format
+#define TRACE_OP_HEADER 'T'  // Opcode of the record that opens a trace, whose body is TRACE_VERSION
+
+struct EventSeats;
+
+// A trace is a sequence of records encoded as frames of the framed protocol. The
+// opcode of a record is the opcode of the request, and its body holds, as varints:
+//   - nanoseconds since the previous record (since the header for the first one)
+//   - id of the session that sent the request
+//   - the arguments of the request:
+//       '3' CREATE       event id, rows, columns
+//       '4' RESERVE      event id, number of seats, then the row and column of each seat
+//       '5' SHOW         event id
+//       'M' RESERVE_ALL  number of events, then the arguments of a RESERVE for each
+//       '6' LIST, '9' STATS and '2' end of session take none
+// Records are in the order the server decoded the requests. The end of a session
+// is recorded whether the client quit or went away, so a session id that a later
+// session reuses starts a new session.
+
+/// Starts recording every decoded request to a new trace file.
+/// @note Records are buffered and written when a session ends, when the buffer
+/// fills up and every TRACE_FLUSH_INTERVAL_MS, so a killed server loses at most
+/// that much of the sessions still open.
+/// @param path Path of the file, replaced if it exists.
+/// @return 0 if recording started successfully, 1 otherwise.
+int trace_open(const char *path);
+
+/// Writes the buffered records and stops recording.
+void trace_close(void);
+
+/// Records a request that takes no arguments.
+/// @param session_id Id of the session that sent the request.
+/// @param op_code Opcode of the request.
+void trace_request(int session_id, char op_code);
+
+/// Records a CREATE request.
+/// @param session_id Id of the session that sent the request.
+/// @param event_id Id of the event to be created.
+/// @param num_rows Number of rows of the event.
+/// @param num_cols Number of columns of the event.
+void trace_create(int session_id, unsigned int event_id, size_t num_rows, size_t num_cols);
+
+/// Records a RESERVE request.
+/// @param session_id Id of the session that sent the request.
+/// @param event_id Id of the event.
+/// @param num_seats Number of seats.
+/// @param xs Rows of the seats.
+/// @param ys Columns of the seats.
+void trace_reserve(int session_id, unsigned int event_id, size_t num_seats, const size_t *xs, const size_t *ys);
+
+/// Records a RESERVE_ALL request.
+/// @param session_id Id of the session that sent the request.
+/// @param num_events Number of events.
+/// @param parts Seats to reserve in each event.
+void trace_reserve_all(int session_id, size_t num_events, const struct EventSeats *parts);
+
+/// Records a SHOW request.
+/// @param session_id Id of the session that sent the request.
+/// @param event_id Id of the event.
+void trace_show(int session_id, unsigned int event_id);
+
+#endif  // SERVER_TRACE_H